@@ -4,24 +4,52 @@ CONFIG += qwt
 SOURCES = \
     sources/main.cc \
     sources/application.cc \
+    sources/sweepcontroller.cc \
     sources/mainwindow.cc \
     sources/audiosys.cc \
+    sources/audiooptions.cc \
+    sources/jackbackend.cc \
+    sources/offlinebackend.cc \
     sources/audioprocessor.cc \
+    sources/sweepanalyzer.cc \
+    sources/mlsanalyzer.cc \
+    sources/multitonedesigner.cc \
+    sources/filterfit.cc \
+    sources/profile.cc \
     sources/analyzerdefs.cc \
     sources/messages.cc \
-    sources/utility/ring_buffer.cpp
+    sources/utility/ring_buffer.cpp \
+    sources/utility/event_fd.cpp \
+    sources/utility/counting_bitset.cpp
 
 HEADERS = \
     sources/application.h \
+    sources/sweepcontroller.h \
     sources/mainwindow.h \
     sources/audiosys.h \
+    sources/audiooptions.h \
+    sources/audiobackend.h \
+    sources/jackbackend.h \
+    sources/offlinebackend.h \
     sources/audioprocessor.h \
+    sources/sweepanalyzer.h \
+    sources/mlsanalyzer.h \
+    sources/multitonedesigner.h \
+    sources/filterfit.h \
+    sources/profile.h \
     sources/analyzerdefs.h \
     sources/messages.h \
+    sources/dsp/amp_follower.h \
+    sources/dsp/osc_bank.h \
+    sources/dsp/partitioned_convolver.h \
+    sources/dsp/iir_filter.h \
+    sources/dsp/complex_mac.h \
+    sources/dsp/window.h \
     sources/utility/nextpow2.h \
+    sources/utility/fftw_memory.h \
     sources/utility/ring_buffer.h \
-    sources/utility/counting_bitset.h \
-    sources/utility/counting_bitset.tcc
+    sources/utility/event_fd.h \
+    sources/utility/counting_bitset.h
 
 FORMS = \
     forms/mainwindow.ui
@@ -0,0 +1,55 @@
+QT = core
+CONFIG += console
+CONFIG -= app_bundle
+
+SOURCES = \
+    sources/batch.cc \
+    sources/sweepcontroller.cc \
+    sources/audiosys.cc \
+    sources/audiooptions.cc \
+    sources/jackbackend.cc \
+    sources/offlinebackend.cc \
+    sources/audioprocessor.cc \
+    sources/sweepanalyzer.cc \
+    sources/mlsanalyzer.cc \
+    sources/multitonedesigner.cc \
+    sources/filterfit.cc \
+    sources/profile.cc \
+    sources/analyzerdefs.cc \
+    sources/messages.cc \
+    sources/utility/ring_buffer.cpp \
+    sources/utility/event_fd.cpp \
+    sources/utility/counting_bitset.cpp
+
+HEADERS = \
+    sources/sweepcontroller.h \
+    sources/audiosys.h \
+    sources/audiooptions.h \
+    sources/audiobackend.h \
+    sources/jackbackend.h \
+    sources/offlinebackend.h \
+    sources/audioprocessor.h \
+    sources/sweepanalyzer.h \
+    sources/mlsanalyzer.h \
+    sources/multitonedesigner.h \
+    sources/filterfit.h \
+    sources/profile.h \
+    sources/analyzerdefs.h \
+    sources/messages.h \
+    sources/dsp/amp_follower.h \
+    sources/dsp/osc_bank.h \
+    sources/dsp/partitioned_convolver.h \
+    sources/dsp/iir_filter.h \
+    sources/dsp/complex_mac.h \
+    sources/dsp/window.h \
+    sources/utility/nextpow2.h \
+    sources/utility/fftw_memory.h \
+    sources/utility/ring_buffer.h \
+    sources/utility/event_fd.h \
+    sources/utility/counting_bitset.h
+
+LIBS = -ljack -lfftw3f
+
+DESTDIR = build
+OBJECTS_DIR = build/obj/batch
+MOC_DIR = build/moc/batch
@@ -0,0 +1,170 @@
+//          Copyright Jean Pierre Cimalando 2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+// Measures the cost of the audio callback per period, sweeping the sample
+// rate, the period size and the number of simultaneous bins, and compares
+// it with the real-time deadline of the period; then the same with the
+// device emulated, by the longest impulse response and by a filter.
+
+#include "audioprocessor.h"
+#include "analyzerdefs.h"
+#include "messages.h"
+#include <algorithm>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include <cstdint>
+#include <cmath>
+#if defined(__x86_64__) || defined(__i386__)
+#   include <x86intrin.h>
+#endif
+
+static uint64_t read_cycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+static double cycles_per_second()
+{
+    typedef std::chrono::steady_clock clock;
+    clock::time_point t1 = clock::now();
+    uint64_t c1 = read_cycles();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    clock::time_point t2 = clock::now();
+    uint64_t c2 = read_cycles();
+    return (c2 - c1) / std::chrono::duration<double>(t2 - t1).count();
+}
+
+static void request_analysis(Audio_Processor &proc, unsigned num_bins)
+{
+    auto msg = Messages::create<Messages::RequestAnalyzeFrequency>(num_bins);
+    msg->serial = 0;
+    msg->spl = 0;
+    msg->amplitude = Analysis::output_gain_default;
+    msg->index = 0;
+    msg->window = Analysis::Window_Hann;
+    msg->averages = 1;
+    msg->num_bins = num_bins;
+    float *frequency = msg->frequency();
+    float *phase = msg->phase();
+    for (unsigned a = 0; a < num_bins; ++a) {
+        const double lx1 = std::log10((double)Analysis::freq_range_min);
+        const double lx2 = std::log10((double)Analysis::freq_range_max);
+        double r = (num_bins > 1) ? ((double)a / (num_bins - 1)) : 0.5;
+        frequency[a] = std::pow(10.0, lx1 + r * (lx2 - lx1));
+        phase[a] = 0;
+    }
+    // the cost of the callback does not depend on the phases
+    msg->gain = 1.0f / num_bins;
+    proc.send_message(*msg);
+}
+
+int main()
+{
+    static const float sample_rates[] = {44100, 48000, 96000, 192000};
+    static const unsigned num_captures = 4;
+
+    const double cps = cycles_per_second();
+    const unsigned max_bins = std::min<unsigned>(Analysis::max_bins_at_once, 1024);
+
+    std::printf("%8s %6s %5s %5s %10s %10s %10s %10s %10s %7s %7s\n",
+                "rate", "period", "model", "bins", "min", "median", "p99", "max", "deadline", "p99%", "max%");
+
+    // a decaying noise of the full length, and a filter of the highest order
+    const unsigned ir_length = Analysis::emulation_fir_length;
+    std::unique_ptr<float[]> ir(new float[ir_length]);
+    for (unsigned i = 0; i < ir_length; ++i)
+        ir[i] = std::exp(-8.0 * i / ir_length) * ((i * 2654435761u >> 16) % 2001 - 1000) * 1e-4f;
+    std::vector<double> iir_b(Analysis::filter_order_max + 1, 0.0);
+    std::vector<double> iir_a(Analysis::filter_order_max + 1, 0.0);
+    iir_b[0] = iir_a[0] = 1;
+
+    for (float sr : sample_rates) {
+        Analysis::sample_rate = sr;
+        Audio_Processor proc;
+        const unsigned fft_size = proc.fft_size();
+
+        for (unsigned period = 16; period <= 4096; period *= 2) {
+            std::unique_ptr<float[]> in(new float[period]());
+            std::unique_ptr<float[]> out(new float[period]());
+            const float *in_channels[] = {in.get()};
+            float *out_channels[] = {out.get()};
+
+            for (int model : {Analysis::Emulation_Live, Analysis::Emulation_Fir, Analysis::Emulation_Iir}) {
+                for (unsigned num_bins = 1;; num_bins *= 2) {
+                    num_bins = std::min(num_bins, max_bins);
+
+                    // the emulation is measured with a single tone, switched to
+                    // at the first period
+                    static const char *const model_names[] = {"-", "fir", "iir"};
+                    if (model == Analysis::Emulation_Fir) {
+                        const float *irs[] = {ir.get()};
+                        proc.set_emulation_fir(irs, ir_length);
+                    }
+                    else if (model == Analysis::Emulation_Iir) {
+                        const double *b[] = {iir_b.data()};
+                        const double *a[] = {iir_a.data()};
+                        proc.set_emulation_iir(b, iir_b.size(), a, iir_a.size());
+                    }
+
+                    std::vector<uint64_t> costs;
+                    unsigned captures = 0;
+
+                    request_analysis(proc, num_bins);
+                    while (captures < num_captures) {
+                        uint64_t t1 = read_cycles();
+                        proc.process(in_channels, out_channels, period);
+                        uint64_t t2 = read_cycles();
+                        costs.push_back(t2 - t1);
+
+                        std::copy_n(out.get(), period, in.get());
+
+                        while (Basic_Message *hmsg = proc.receive_message()) {
+                            if (hmsg->tag == Message_Tag::NotifyFrequencyAnalysis && ++captures < num_captures)
+                                request_analysis(proc, num_bins);
+                        }
+                    }
+
+                    Messages::RequestStop stop;
+                    proc.send_message(stop);
+
+                    std::sort(costs.begin(), costs.end());
+                    const size_t count = costs.size();
+                    uint64_t c_min = costs.front();
+                    uint64_t c_med = costs[count / 2];
+                    uint64_t c_p99 = costs[std::min(count - 1, (size_t)(0.99 * count))];
+                    uint64_t c_max = costs.back();
+                    double deadline = cps * period / sr;
+
+                    std::printf("%8.0f %6u %5s %5u %10llu %10llu %10llu %10llu %10.0f %6.1f%% %6.1f%%\n",
+                                sr, period, model_names[model], num_bins,
+                                (unsigned long long)c_min, (unsigned long long)c_med,
+                                (unsigned long long)c_p99, (unsigned long long)c_max,
+                                deadline, 100 * c_p99 / deadline, 100 * c_max / deadline);
+                    std::fflush(stdout);
+
+                    if (model != Analysis::Emulation_Live) {
+                        proc.set_emulation_live();
+                        proc.process(in_channels, out_channels, period);
+                        break;
+                    }
+                    if (num_bins == max_bins)
+                        break;
+                }
+            }
+        }
+
+        std::fprintf(stderr, "fft size %u at %.0f Hz\n", fft_size, sr);
+    }
+
+    return 0;
+}
@@ -0,0 +1,23 @@
+TEMPLATE = app
+CONFIG += console
+CONFIG -= qt
+CONFIG += c++11
+
+INCLUDEPATH += ../sources
+
+SOURCES = \
+    callback_bench.cc \
+    ../sources/audioprocessor.cc \
+    ../sources/sweepanalyzer.cc \
+    ../sources/mlsanalyzer.cc \
+    ../sources/multitonedesigner.cc \
+    ../sources/audiosys.cc \
+    ../sources/analyzerdefs.cc \
+    ../sources/messages.cc \
+    ../sources/utility/ring_buffer.cpp \
+    ../sources/utility/event_fd.cpp
+
+LIBS = -lfftw3f -lpthread
+
+DESTDIR = ../build
+OBJECTS_DIR = ../build/obj/bench
@@ -9,6 +9,6 @@
 namespace Analysis {
 
 float sample_rate;
-float global_gain = 0.5f;
+unsigned num_channels = 1;
 
 }  // namespace Analysis
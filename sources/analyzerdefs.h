@@ -4,6 +4,9 @@
 //          http://www.boost.org/LICENSE_1_0.txt)
 
 #pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 
 namespace Analysis {
 
@@ -17,37 +20,143 @@ enum {
     db_range_max = +40,
 };
 
+// number of points of the sweep, configurable at run time
 enum {
-    sweep_length = 128,
+    sweep_length_min = 16,
+    sweep_length_max = 8192,
+    sweep_length_default = 128,
 };
 
+enum Measurement_Mode {
+    Mode_Stepped,
+    Mode_Sweep,
+    Mode_Mls,
+};
+
+// exponential sine sweep: harmonic orders separated beyond the linear
+// response, starting at H2, and sweep duration in seconds
+enum {
+    ess_num_harmonics = 4,
+};
+
+[[gnu::unused]] static constexpr float ess_duration = 2.0f;
+
+// harmonic distortion of a single tone, read on its spectrum: the orders
+// from H2, and the floor of the plots in dB relative to the fundamental
+enum {
+    distortion_num_harmonics = 8,
+};
+
+[[gnu::unused]] static constexpr float distortion_db_min = -120.0f;
+
+// up to this many bins, analyze by direct DFT in place of a full FFT
+enum {
+    sparse_max_bins = 8,
+};
+
+// averaging of the stepped sine over frames of the capture, which overlap
+// by half unless unwindowed, and the coherence under which a point is
+// marked unreliable
+enum {
+    averages_max = 8,
+};
+
+[[gnu::unused]] static constexpr float coherence_min = 0.9f;
+
+// repetition of the stepped points, each until the 95% confidence interval
+// of its magnitude is narrow enough, up to a number of measurements
+enum {
+    repeats_min = 2,
+    repeats_max = 32,
+    repeats_default = 8,
+};
+
+[[gnu::unused]] static constexpr float confidence_db_max = 6.0f;
+
+// drive levels, a list of amplitudes relative to the full scale which is
+// set at run time; messages designate a level by its index in the list, and
+// carry its amplitude with the output gain
 enum {
-    max_bins_at_once = 32,
+    levels_max = 16,
 };
 
-enum Signal_Pseudo_Level {
-    Signal_Lo,
-    Signal_Hi,
+[[gnu::unused]] static constexpr float level_db_min = -80.0f;
+[[gnu::unused]] static constexpr float output_gain_default = 0.5f;
+
+enum Window_Function {
+    Window_Hann,
+    Window_Blackman_Harris,
+    Window_Flat_Top,
+    Window_Rectangular,
+    Window_Function_Count,
+};
+
+// channels measured at once, each an input with the generator sent to its
+// own output as well; set from the audio system, as the sample rate
+enum {
+    channels_max = 32,
 };
 
 extern float sample_rate;
-extern float global_gain;
+extern unsigned num_channels;
+
+// the most tones of a multitone request, up to all points of the sweep
+enum {
+    max_bins_at_once = sweep_length_max,
+};
 
 [[gnu::unused]] static constexpr float silence_threshold = 1e-4f;
 
-inline constexpr double spl_amplitude(int spl)
-{
-    return (spl == Signal_Hi) ? 1.0 : 0.01;
-}
+// least gain of the round trip for which a latency measurement is valid,
+// and least ratio of the peak to the RMS of the tail of the response
+[[gnu::unused]] static constexpr float latency_min_peak = 1e-3f;
+[[gnu::unused]] static constexpr float latency_min_dominance = 10.0f;
+
+// settling between steps: the decay in dB of the residual of a step, below
+// which the next one may be captured, and the duration of the cross-fade
+// which replaces the silence when there is no need to wait
+enum {
+    settle_margin_min = 20,
+    settle_margin_max = 120,
+    settle_margin_default = 60,
+};
+
+[[gnu::unused]] static constexpr float crossfade_duration = 5e-3f;
+
+// filter fitted to the measured response, on the bins of an FFT of this
+// size: the orders of its numerator and denominator, and the iterations
+// which refine the fit
+enum {
+    filter_fft_size = 1024,
+    filter_order_max = 32,
+    filter_order_default = 7,
+    filter_iterations_max = 20,
+    filter_iterations_default = 5,
+};
+
+// emulation of the device by a model of its measured response, in place of
+// the device: the length of the minimum-phase impulse response, and the
+// longest period of which the model is computed in a call
+enum Emulation_Mode {
+    Emulation_Live,
+    Emulation_Fir,
+    Emulation_Iir,
+};
+
+enum {
+    emulation_fir_length = 8192,
+    emulation_period_max = 8192,
+};
 
-inline double global_amplitude(int spl)
+inline unsigned frequency_bin(double frequency, unsigned fft_size)
 {
-    return spl_amplitude(spl) * global_gain;
+    unsigned bin = std::lround(fft_size * frequency / sample_rate);
+    return std::min(bin, fft_size / 2);
 }
 
-inline unsigned nth_bin_position(unsigned sweep_index, unsigned nth_bin, unsigned count_at_once)
+inline unsigned nth_bin_position(unsigned sweep_index, unsigned nth_bin, unsigned count_at_once, unsigned sweep_length)
 {
-    return (sweep_index + nth_bin * Analysis::sweep_length / count_at_once) % Analysis::sweep_length;
+    return (sweep_index + (uint64_t)nth_bin * sweep_length / count_at_once) % sweep_length;
 }
 
 }  // namespace Analysis
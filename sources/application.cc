@@ -5,47 +5,36 @@
 
 #include "application.h"
 #include "mainwindow.h"
+#include "sweepcontroller.h"
 #include "audioprocessor.h"
-#include "analyzerdefs.h"
-#include "messages.h"
-#include "utility/counting_bitset.h"
+#include "profile.h"
 #include <QFileDialog>
+#include <QFileInfo>
+#include <QDir>
 #include <QMessageBox>
 #include <QTimer>
 #include <QDebug>
-#include <fstream>
-#include <iomanip>
+#include <vector>
 #include <complex>
 #include <cmath>
-#include <cassert>
 typedef std::complex<float> cfloat;
 
 struct Application::Impl {
     Audio_Processor *proc_ = nullptr;
     MainWindow *mainwindow_ = nullptr;
     QTimer *tm_rtupdates_ = nullptr;
-    QTimer *tm_nextsweep_ = nullptr;
-
-    std::unique_ptr<double[]> an_freqs_;
-    std::unique_ptr<cfloat[]> an_lo_response_;
-    std::unique_ptr<cfloat[]> an_hi_response_;
-
-    std::unique_ptr<double[]> an_lo_plot_mags_;
-    std::unique_ptr<double[]> an_lo_plot_phases_;
-    std::unique_ptr<double[]> an_hi_plot_mags_;
-    std::unique_ptr<double[]> an_hi_plot_phases_;
-
-    bool sweep_active_ = false;
-    unsigned sweep_index_ = 0;
-    int sweep_spl_ = Analysis::Signal_Lo;
-    unsigned freqs_at_once_ = 1;
-    counting_bitset<Analysis::sweep_length> sweep_progress_;
-
-    bool lo_enable_ = true;
-    bool hi_enable_ = true;
-    int next_spl_phase(int spl) const;
-    bool enabled_spl(int spl) const;
-    void set_sweep_phase(int spl);
+    std::unique_ptr<SweepController> controller_;
+    unsigned plot_channel_ = 0;
+
+    // the matrices of the plots of the references, on their own frequencies
+    // for the plotted channel, in the order of the controller
+    struct Reference_Plot {
+        std::unique_ptr<double[]> mags;
+        std::unique_ptr<double[]> phases;
+    };
+    std::vector<Reference_Plot> reference_plots_;
+
+    void plot_reference(unsigned index);
 };
 
 Application::Application(int &argc, char *argv[])
@@ -56,10 +45,6 @@ Application::Application(int &argc, char *argv[])
     tm = P->tm_rtupdates_ = new QTimer(this);
     connect(tm, &QTimer::timeout, this, &Application::realtimeUpdateTick);
     tm->start(50);
-
-    tm = P->tm_nextsweep_ = new QTimer(this);
-    tm->setSingleShot(true);
-    connect(tm, &QTimer::timeout, this, &Application::nextSweepTick);
 }
 
 Application::~Application()
@@ -70,74 +55,125 @@ void Application::setAudioProcessor(Audio_Processor &proc)
 {
     P->proc_ = &proc;
 
-    const unsigned ns = Analysis::sweep_length;
-    double *freqs = new double[ns];
-    P->an_freqs_.reset(freqs);
+    SweepController *ctl = new SweepController(proc);
+    P->controller_.reset(ctl);
+
+    connect(ctl, &SweepController::driveLevelsChanged,
+            this, [this]() { P->mainwindow_->showDriveLevels(); });
+    connect(ctl, &SweepController::sweepPhaseChanged, this, &Application::sweepPhaseChanged);
+    connect(ctl, &SweepController::responsesChanged, this, &Application::replotResponses);
+    connect(ctl, &SweepController::currentFrequencyChanged,
+            this, [this](double freq) { P->mainwindow_->showCurrentFrequency(freq); });
+    connect(ctl, &SweepController::progressChanged,
+            this, [this](double progress) { P->mainwindow_->showProgress(progress); });
+    connect(ctl, &SweepController::latencyMeasured,
+            this, [this](int latency) { P->mainwindow_->showLatency(latency); });
+}
 
-    for (unsigned i = 0; i < ns; ++i) {
-        const double lx1 = std::log10((double)Analysis::freq_range_min);
-        const double lx2 = std::log10((double)Analysis::freq_range_max);
-        double r = (double)i / (ns - 1);
-        freqs[i] = std::pow(10.0, lx1 + r * (lx2 - lx1));
-    }
+void Application::setMainWindow(MainWindow &win)
+{
+    P->mainwindow_ = &win;
+}
 
-    P->an_lo_response_.reset(new cfloat[ns]());
-    P->an_hi_response_.reset(new cfloat[ns]());
+void Application::setDriveLevels(const double *levels, unsigned count)
+{
+    P->controller_->setDriveLevels(levels, count);
+}
 
-    P->an_lo_plot_mags_.reset(new double[ns]());
-    P->an_lo_plot_phases_.reset(new double[ns]());
-    P->an_hi_plot_mags_.reset(new double[ns]());
-    P->an_hi_plot_phases_.reset(new double[ns]());
+unsigned Application::numLevels() const
+{
+    return P->controller_->numLevels();
 }
 
-void Application::setMainWindow(MainWindow &win)
+double Application::driveLevel(unsigned index) const
 {
-    P->mainwindow_ = &win;
+    return P->controller_->driveLevel(index);
 }
 
-void Application::setSweepEnabled(bool lo, bool hi)
+void Application::setOutputGain(double gain)
 {
-    if (lo == P->lo_enable_ && hi == P->hi_enable_)
-        return;
+    P->controller_->setOutputGain(gain);
+}
 
-    bool disabled = !P->lo_enable_ && !P->hi_enable_;
-    P->lo_enable_ = lo;
-    P->hi_enable_ = hi;
+double Application::outputGain() const
+{
+    return P->controller_->outputGain();
+}
 
-    P->sweep_progress_.reset();
-    P->mainwindow_->showProgress(0);
+void Application::setSweepLength(unsigned count)
+{
+    P->controller_->setSweepLength(count);
+}
 
-    if (disabled) {
-        int next = P->next_spl_phase(P->sweep_spl_);
-        if (next != -1) {
-            P->set_sweep_phase(next);
-            P->tm_nextsweep_->start(0);
-        }
-    }
+unsigned Application::sweepLength() const
+{
+    return P->controller_->sweepLength();
 }
 
 void Application::setFreqsAtOnce(unsigned count)
 {
-    P->freqs_at_once_ = count;
+    P->controller_->setFreqsAtOnce(count);
 }
 
-void Application::setSweepActive(bool active)
+void Application::setWindowFunction(int window)
+{
+    P->controller_->setWindowFunction(window);
+}
+
+void Application::setAverages(unsigned count)
+{
+    P->controller_->setAverages(count);
+}
+
+void Application::setConfidence(double width)
+{
+    P->controller_->setConfidence(width);
+}
+
+void Application::setMaxRepeats(unsigned count)
+{
+    P->controller_->setMaxRepeats(count);
+}
+
+void Application::setMeasurementMode(int mode)
+{
+    P->controller_->setMeasurementMode(mode);
+}
+
+void Application::setSettleMargin(double margin)
 {
-    if (P->sweep_active_ == active)
+    P->controller_->setSettleMargin(margin);
+}
+
+void Application::setCrossfade(bool enable)
+{
+    P->controller_->setCrossfade(enable);
+}
+
+unsigned Application::numChannels() const
+{
+    return P->controller_->numChannels();
+}
+
+void Application::setPlotChannel(unsigned channel)
+{
+    if (channel >= numChannels() || channel == P->plot_channel_)
         return;
 
-    P->sweep_active_ = active;
-    if (!active) {
-        P->tm_nextsweep_->stop();
+    P->plot_channel_ = channel;
+    for (unsigned i = 0, n = P->reference_plots_.size(); i < n; ++i)
+        P->plot_reference(i);
+    replotResponses();
+}
 
-        Messages::RequestStop msg;
-        P->proc_->send_message(msg);
-    }
-    else {
-        P->sweep_progress_.reset();
-        P->mainwindow_->showProgress(0);
-        P->tm_nextsweep_->start(0);
-    }
+void Application::setSweepActive(bool active)
+{
+    P->controller_->setSweepActive(active);
+}
+
+void Application::measureLatency()
+{
+    P->controller_->measureLatency();
 }
 
 void Application::saveProfile()
@@ -150,155 +186,110 @@ void Application::saveProfile()
     if (filename.isEmpty())
         return;
 
-    QDir(filename).mkpath(".");
+    if (!P->controller_->saveProfile(filename))
+        QMessageBox::warning(P->mainwindow_, tr("Output error"), tr("Could not save profile data."));
+}
 
-    cfloat *responses[] = {
-        P->an_lo_response_.get(),
-        P->an_hi_response_.get(),
-    };
-    bool response_enabled[] = {
-        P->lo_enable_,
-        P->hi_enable_,
-    };
-    const char *response_names[] = {
-        "lo",
-        "hi",
-    };
+void Application::loadReferences()
+{
+    QStringList filenames = QFileDialog::getOpenFileNames(
+        P->mainwindow_, tr("Load references"),
+        QString(),
+        tr("Profile (profile.bin map.dat map-ch1.dat)"));
 
-    for (unsigned r = 0; r < 2; ++r) {
-        if (!response_enabled[r])
+    SweepController &ctl = *P->controller_;
+    for (const QString &filename : filenames) {
+        if (!ctl.addReference(filename)) {
+            QMessageBox::warning(P->mainwindow_, tr("Input error"), tr("Could not load profile data: %1").arg(filename));
             continue;
-        std::ofstream file((filename + "/" + response_names[r] + ".dat").toLocal8Bit().data());
-        file << std::scientific << std::setprecision(10);
-        for (unsigned i = 0; i < Analysis::sweep_length; ++i) {
-            double freq = P->an_freqs_[i];
-            cfloat response = responses[r][i];
-            file << freq << ' ' << std::abs(response) << ' ' << std::arg(response) << '\n';
-        }
-        if (!file.flush()) {
-            QMessageBox::warning(P->mainwindow_, tr("Output error"), tr("Could not save profile data."));
-            return;
         }
+
+        const unsigned index = ctl.numReferences() - 1;
+        const Profile::Header &hdr = ctl.referenceHeader(index);
+        const unsigned size = hdr.num_levels * hdr.num_points;
+        Impl::Reference_Plot plot;
+        plot.mags.reset(new double[size]);
+        plot.phases.reset(new double[size]);
+        P->reference_plots_.push_back(std::move(plot));
+        P->plot_reference(index);
+
+        P->mainwindow_->addReference(
+            QFileInfo(filename).dir().dirName(), (const double *)ctl.referenceColumns(index)[Profile::Column_Frequency],
+            P->reference_plots_[index].mags.get(), P->reference_plots_[index].phases.get(),
+            hdr.level_db, hdr.num_levels, hdr.num_points);
     }
 }
 
-void Application::realtimeUpdateTick()
+void Application::clearReferences()
 {
-    Audio_Processor &proc = *P->proc_;
-
-    while (Basic_Message *hmsg = proc.receive_message()) {
-        switch (hmsg->tag) {
-        case Message_Tag::NotifyFrequencyAnalysis: {
-            auto *msg = (Messages::NotifyFrequencyAnalysis *)hmsg;
-
-            int spl = msg->spl;
-            if (spl == -1)
-                return;
-
-            unsigned index = P->sweep_index_;
-
-            double *an_freqs = P->an_freqs_.get();
-            cfloat *response = ((spl == Analysis::Signal_Hi) ?
-                                P->an_hi_response_ : P->an_lo_response_).get();
-
-            unsigned done_bins = msg->num_bins;
-            for (unsigned a = 0; a < done_bins; ++a)  {
-                unsigned dst_index = Analysis::nth_bin_position(index, a, done_bins);
-
-                an_freqs[dst_index] = msg->frequency[a];
-                response[dst_index] = msg->response[a];
-
-                double *plot_mags = ((spl == Analysis::Signal_Hi) ?
-                                     P->an_hi_plot_mags_ : P->an_lo_plot_mags_).get();
-                double *plot_phases = ((spl == Analysis::Signal_Hi) ?
-                                       P->an_hi_plot_phases_ : P->an_lo_plot_phases_).get();
-
-                plot_mags[dst_index] = 20 * std::log10(std::abs(msg->response[a]));
-                plot_phases[dst_index] = std::arg(msg->response[a]);
-
-                P->sweep_progress_.set(dst_index);
-            }
-
-            index = (index + 1) % Analysis::sweep_length;
-            if (P->sweep_progress_.count() == Analysis::sweep_length || !P->enabled_spl(spl))
-                spl = P->next_spl_phase(P->sweep_spl_);
-            P->sweep_index_ = index;
-            P->set_sweep_phase(spl);
+    P->mainwindow_->clearReferences();
+    P->reference_plots_.clear();
+    P->controller_->clearReferences();
+}
 
-            P->mainwindow_->showProgress(P->sweep_progress_.count() * (1.0 / Analysis::sweep_length));
+void Application::setFilterOrder(unsigned zeros, unsigned poles)
+{
+    P->controller_->setFilterOrder(zeros, poles);
+}
 
-            replotResponses();
+void Application::setFilterIterations(unsigned count)
+{
+    P->controller_->setFilterIterations(count);
+}
 
-            if (P->sweep_active_)
-                P->tm_nextsweep_->start(0);
-            break;
-        }
-        default:
-            assert(false);
-            break;
-        }
-    }
+bool Application::setEmulation(int mode, unsigned level)
+{
+    bool ok = P->controller_->setEmulation(mode, level);
+    if (!ok)
+        QMessageBox::warning(P->mainwindow_, tr("Emulation error"), tr("There is no model of the response at this level."));
+    return ok;
+}
 
-    MainWindow &window = *P->mainwindow_;
-    window.showLevels(proc.input_level(), proc.output_level());
+void Application::fitFilters()
+{
+    P->controller_->fitFilters();
 }
 
-void Application::nextSweepTick()
+void Application::realtimeUpdateTick()
 {
     Audio_Processor &proc = *P->proc_;
-    unsigned index = P->sweep_index_;
-
-    Messages::RequestAnalyzeFrequency msg;
-    msg.spl = P->sweep_spl_;
-    msg.num_bins = P->freqs_at_once_;
-    for (unsigned a = 0; a < msg.num_bins; ++a) {
-        unsigned src_index = Analysis::nth_bin_position(index, a, msg.num_bins);
-        msg.frequency[a] = P->an_freqs_[src_index];
-    }
-    proc.send_message(msg);
-
-    P->mainwindow_->showCurrentFrequency(msg.frequency[0]);
+    MainWindow &window = *P->mainwindow_;
+    window.showLevels(proc.input_level(), proc.output_level());
 }
 
 void Application::replotResponses()
 {
-    const unsigned ns = Analysis::sweep_length;
+    const SweepController &ctl = *P->controller_;
+    const unsigned channel = P->plot_channel_;
+    const unsigned levels = ctl.numLevels();
+    const unsigned ns = ctl.sweepLength();
+    const double *freqs = ctl.frequencies();
+
+    P->mainwindow_->showFilter(freqs, ctl.plotFilter(channel), levels, ns, ctl.filterError(channel));
+
+    P->mainwindow_->showDifference(
+        freqs, ctl.plotDifferenceMagnitudes(channel), ctl.plotDifferencePhases(channel),
+        levels, ns, ctl.deviation());
+
     P->mainwindow_->showPlotData
-        (P->an_freqs_.get(), P->an_freqs_[P->sweep_index_],
-         P->an_lo_plot_mags_.get(), P->an_lo_plot_phases_.get(),
-         P->an_hi_plot_mags_.get(), P->an_hi_plot_phases_.get(),
-         ns);
+        (freqs, freqs[ctl.sweepIndex()],
+         ctl.plotMagnitudes(channel), ctl.plotPhases(channel),
+         ctl.plotThd(channel), ctl.plotThdn(channel),
+         ctl.coherence(channel), levels, ns);
 }
 
-int Application::Impl::next_spl_phase(int spl) const
-{
-    if (!lo_enable_ && !hi_enable_)
-        return -1;
-    else if ((spl == -1 || spl == Analysis::Signal_Hi) && lo_enable_)
-        return Analysis::Signal_Lo;
-    else if ((spl == -1 || spl == Analysis::Signal_Lo) && hi_enable_)
-        return Analysis::Signal_Hi;
-    else
-        return spl;
-}
 
-bool Application::Impl::enabled_spl(int spl) const
-{
-    switch (spl) {
-    default:
-        return false;
-    case Analysis::Signal_Lo:
-        return lo_enable_;
-    case Analysis::Signal_Hi:
-        return hi_enable_;
-    }
-}
 
-void Application::Impl::set_sweep_phase(int spl)
+void Application::Impl::plot_reference(unsigned index)
 {
-    if (sweep_spl_ == spl)
-        return;
-    sweep_spl_ = spl;
-    sweep_progress_.reset();
-    emit theApplication->sweepPhaseChanged(spl);
+    const Profile::Header &hdr = controller_->referenceHeader(index);
+    const void *const *columns = controller_->referenceColumns(index);
+    Reference_Plot &plot = reference_plots_[index];
+    const unsigned n = hdr.num_points;
+    const unsigned channel = (plot_channel_ < hdr.num_channels) ? plot_channel_ : 0;
+    const cfloat *response = (const cfloat *)columns[Profile::Column_Response] + channel * hdr.num_levels * n;
+    for (unsigned i = 0, size = hdr.num_levels * n; i < size; ++i) {
+        plot.mags[i] = 20 * std::log10(std::abs(response[i]));
+        plot.phases[i] = std::arg(response[i]);
+    }
 }
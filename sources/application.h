@@ -9,6 +9,8 @@
 class Audio_Processor;
 class MainWindow;
 
+// The interface of the measurement: it shows the sweep controller in the
+// main window, and asks the files of the user.
 class Application : public QApplication {
     Q_OBJECT
 
@@ -19,21 +21,52 @@ public:
     void setAudioProcessor(Audio_Processor &proc);
     void setMainWindow(MainWindow &win);
 
-    void setSweepEnabled(bool lo, bool hi);
+    // the drive levels in dB, each measured at every step of the sweep
+    void setDriveLevels(const double *levels, unsigned count);
+    unsigned numLevels() const;
+    double driveLevel(unsigned index) const;
+    void setOutputGain(double gain);
+    double outputGain() const;
+    void setSweepLength(unsigned count);
+    unsigned sweepLength() const;
     void setFreqsAtOnce(unsigned count);
+    void setWindowFunction(int window);
+    void setAverages(unsigned count);
+    // the width in dB of the confidence interval which ends the repetition
+    // of a stepped point, 0 for a single measurement; and the most
+    // measurements of a point
+    void setConfidence(double width);
+    void setMaxRepeats(unsigned count);
+    void setMeasurementMode(int mode);
+    void setSettleMargin(double margin);
+    void setCrossfade(bool enable);
+    unsigned numChannels() const;
+    void setPlotChannel(unsigned channel);
+    // the filter fitted to the response of each channel and level: the
+    // orders of its numerator and denominator, and the iterations which
+    // refine it
+    void setFilterOrder(unsigned zeros, unsigned poles);
+    void setFilterIterations(unsigned count);
+    // the device, or in its place the model of its response at a level:
+    // the minimum-phase impulse response, or the fitted filter; false if
+    // there is no model of this level
+    bool setEmulation(int mode, unsigned level);
 
 signals:
     void sweepPhaseChanged(int spl);
 
 public slots:
     void setSweepActive(bool active);
+    void measureLatency();
     void saveProfile();
+    // saved profiles drawn behind the measurement, of which the first is
+    // subtracted from it as it is measured
+    void loadReferences();
+    void clearReferences();
+    void fitFilters();
 
 protected slots:
     void realtimeUpdateTick();
-    void nextSweepTick();
-
-private:
     void replotResponses();
 
 private:
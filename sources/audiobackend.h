@@ -0,0 +1,21 @@
+//          Copyright Jean Pierre Cimalando 2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+class Audio_Backend {
+public:
+    // one buffer per channel, for the inputs and for the outputs
+    typedef void (Process_Fn)(const float *const *in, float *const *out, unsigned n, void *userdata);
+
+    virtual ~Audio_Backend() {}
+
+    virtual float sample_rate() const = 0;
+    virtual unsigned buffer_size() const = 0;
+    virtual unsigned num_channels() const = 0;
+
+    virtual void start(Process_Fn *fn, void *data) = 0;
+    virtual void stop() = 0;
+};
@@ -0,0 +1,94 @@
+//          Copyright Jean Pierre Cimalando 2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "audiooptions.h"
+#include "audiosys.h"
+#include "jackbackend.h"
+#include "offlinebackend.h"
+#include "analyzerdefs.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+
+static QString tr(const char *text)
+{
+    return QCoreApplication::translate("Audio_Options", text);
+}
+
+Audio_Options::Audio_Options()
+    : channels("channels", tr("Number of channels, measured at once."), tr("count"), "1"),
+      offline("offline", tr("Run without JACK, against a simulated device.")),
+      sample_rate("sample-rate", tr("Offline sample rate."), tr("hz"), "48000"),
+      buffer_size("buffer-size", tr("Offline period size."), tr("frames"), "256"),
+      input_file("input-file", tr("Offline measurement input of the first channel, raw mono float32."), tr("file")),
+      realtime("realtime", tr("Pace the offline backend to real time.")),
+      loopback_gain("loopback-gain", tr("Gain of the simulated device."), tr("factor"), "1"),
+      loopback_latency("loopback-latency", tr("Latency of the simulated device."), tr("frames"), "0"),
+      loopback_cutoff("loopback-cutoff", tr("Lowpass cutoff of the simulated device, 0 for none."), tr("hz"), "0")
+{
+}
+
+void Audio_Options::add_to(QCommandLineParser &parser) const
+{
+    parser.addOptions({channels, offline, sample_rate, buffer_size, input_file, realtime,
+                       loopback_gain, loopback_latency, loopback_cutoff});
+}
+
+bool Audio_Options::set_up(const QCommandLineParser &parser, const QString &client_name, QString &error) const
+{
+    unsigned channels = parser.value(this->channels).toUInt();
+    if (channels < 1 || channels > Analysis::channels_max) {
+        error = tr("Invalid number of channels");
+        return false;
+    }
+
+    Audio_Sys &sys = Audio_Sys::instance();
+    if (parser.isSet(offline)) {
+        float sample_rate = parser.value(this->sample_rate).toFloat();
+        unsigned buffer_size = parser.value(this->buffer_size).toUInt();
+        if (sample_rate <= 0 || buffer_size == 0) {
+            error = tr("Invalid offline audio settings");
+            return false;
+        }
+
+        bool gain_ok, latency_ok, cutoff_ok;
+        float gain = parser.value(loopback_gain).toFloat(&gain_ok);
+        unsigned latency = parser.value(loopback_latency).toUInt(&latency_ok);
+        float cutoff = parser.value(loopback_cutoff).toFloat(&cutoff_ok);
+        if (!gain_ok || !latency_ok || !cutoff_ok || cutoff < 0 || cutoff >= sample_rate / 2) {
+            error = tr("Invalid settings of the simulated device");
+            return false;
+        }
+
+        // the simulated device on every channel, unless the first one is
+        // played from a file
+        std::unique_ptr<Offline_Backend> backend(new Offline_Backend(sample_rate, buffer_size, channels));
+        for (unsigned c = 0; c < channels; ++c)
+            backend->set_device(std::unique_ptr<Offline_Device>(new Loopback_Device(gain, latency, cutoff / sample_rate)), c);
+        if (parser.isSet(input_file)) {
+            std::unique_ptr<File_Device> device(new File_Device(parser.value(input_file).toLocal8Bit().data()));
+            if (!*device) {
+                error = tr("Cannot read the offline input file");
+                return false;
+            }
+            backend->set_device(std::move(device));
+        }
+        backend->set_realtime(parser.isSet(realtime));
+        sys.set_backend(std::move(backend));
+    }
+    else {
+        std::unique_ptr<Jack_Backend> jack(new Jack_Backend(client_name.toUtf8().data(), channels));
+        if (*jack)
+            sys.set_backend(std::move(jack));
+    }
+
+    if (!sys) {
+        error = tr("Cannot start the JACK audio system");
+        return false;
+    }
+
+    Analysis::sample_rate = sys.sample_rate();
+    Analysis::num_channels = sys.num_channels();
+    return true;
+}
@@ -0,0 +1,30 @@
+//          Copyright Jean Pierre Cimalando 2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+#include <QCommandLineOption>
+class QCommandLineParser;
+class QString;
+
+// The options of the audio system on the command line, common to the
+// interactive and the batch programs.
+struct Audio_Options {
+    Audio_Options();
+
+    QCommandLineOption channels;
+    QCommandLineOption offline;
+    QCommandLineOption sample_rate;
+    QCommandLineOption buffer_size;
+    QCommandLineOption input_file;
+    QCommandLineOption realtime;
+    QCommandLineOption loopback_gain;
+    QCommandLineOption loopback_latency;
+    QCommandLineOption loopback_cutoff;
+
+    void add_to(QCommandLineParser &parser) const;
+    // the backend of the options installed in the audio system, and the
+    // analysis set to its format; false with the reason if it fails
+    bool set_up(const QCommandLineParser &parser, const QString &client_name, QString &error) const;
+};
@@ -7,67 +7,304 @@
 #include "audiosys.h"
 #include "analyzerdefs.h"
 #include "messages.h"
+#include "sweepanalyzer.h"
+#include "mlsanalyzer.h"
+#include "multitonedesigner.h"
 #include "dsp/amp_follower.h"
+#include "dsp/osc_bank.h"
+#include "dsp/window.h"
+#include "dsp/partitioned_convolver.h"
+#include "dsp/iir_filter.h"
 #include "utility/nextpow2.h"
+#include "utility/fftw_memory.h"
 #include "utility/ring_buffer.h"
+#include "utility/event_fd.h"
 #include <fftw3.h>
+#include <semaphore.h>
 #include <algorithm>
 #include <thread>
+#include <mutex>
+#include <atomic>
+#include <cerrno>
 #include <complex>
+#include <system_error>
 #include <cassert>
 typedef std::complex<float> cfloat;
 typedef std::complex<double> cdouble;
 
 struct Audio_Processor::Impl {
-    static void process(const float *in, float *out, unsigned n, void *userdata);
+    static void process(const float *const *in, float *const *out, unsigned n, void *userdata);
     void handle_messages();
     void process_message(const Basic_Message &hmsg);
+    void arm_step(unsigned serial, int spl, float amplitude, unsigned index, int window, unsigned averages, const float *frequency, const float *phase, unsigned num_bins, float gain);
+    void next_step();
+    void request_step();
+    void stop_plan();
     void generate(float *out, unsigned n);
-    void collect(const float *in, unsigned n);
-    void compute_response(cfloat *response);
-    void update_levels(const float *in, float *out, unsigned n);
+    void crossfade(float *out, unsigned n, float gain);
+    bool same_tones(const float *frequency, const float *phase, unsigned num_bins) const;
+    void collect(const float *const *in, unsigned n);
+    void accumulate_sparse(unsigned channel, const float *in, unsigned pos, unsigned n);
+    void start_generator();
+    bool settled() const;
+    unsigned round_trip() const;
+    bool capture_available() const;
+    bool capture_complete() const;
+    unsigned capture_length() const;
+    unsigned frame_hop(int window) const;
+    void submit_capture();
+    void analysis_thread();
+    struct Capture;
+    void compute_response(const Capture &cap);
+    void compose_response(const Capture &cap, Messages::NotifyFrequencyAnalysis &msg);
+    void compute_distortion(const Capture &cap, Messages::NotifyDistortion &msg);
+    void compute_sweep_response();
+    void design_step();
+    void compute_mls_response(const Capture &cap, Messages::NotifyMlsAnalysis &msg);
+    template <class T, class... Counts> T *reserve_notification(Counts... counts);
+    template <class Attempt> static bool wait_for_room(Event_Fd &event, std::atomic<bool> &wanted, Attempt attempt, int timeout_ms = -1);
+    void post_notification(const Basic_Message &msg);
+    void compute_latency(const Capture &cap);
+    void compute_settling();
+    void update_levels(const float *const *in, const float *out, unsigned n);
+    struct Emulation_Bank;
+    Emulation_Bank *emulation_bank(int timeout_ms);
+    void publish_emulation(Emulation_Bank &bank, int mode);
+    void emulate(float *const *out, unsigned n);
 
 /*
     static cdouble interpolate(const cfloat *in, double pos, unsigned size);
     static double interpolate4(const double *y, double mu);
 */
 
-    Amp_Follower<float> in_amp_follower_;
+    unsigned channels_ = 1;
+
+    std::unique_ptr<Amp_Follower<float>[]> in_amp_follower_;
     Amp_Follower<float> out_amp_follower_;
+    std::unique_ptr<float[]> in_amp_channel_;
     float in_amp_ = 0;
     float out_amp_ = 0;
 
     std::unique_ptr<Ring_Buffer> rb_in_;
     std::unique_ptr<Ring_Buffer> rb_out_;
+    // the buffers for the messages which are not contiguous in the ring
+    // buffers: read by the audio thread, composed by the worker, and read
+    // by the receiver, which holds the last one received until the next
     std::unique_ptr<uint8_t[]> rb_in_buf_;
+    std::unique_ptr<uint8_t[]> rb_worker_buf_;
     std::unique_ptr<uint8_t[]> rb_out_buf_;
+    Basic_Message *rb_out_held_ = nullptr;
+
+    // wakeups, of the receiver when there are notifications, of the
+    // sender which waits for the audio thread to make room for a request,
+    // and of the worker which waits for the receiver to make room for a
+    // notification
+    Event_Fd out_event_;
+    Event_Fd in_space_event_;
+    std::atomic<bool> in_space_wanted_{false};
+    Event_Fd out_space_event_;
+    std::atomic<bool> out_space_wanted_{false};
 
     bool active_ = false;
+    int mode_ = Analysis::Mode_Stepped;
 
     bool gen_can_start_ = false;
     bool gen_has_finished_ = false;
-    int gen_spl_ = Analysis::Signal_Lo;
+    // of the request which the measurement is for
+    unsigned gen_serial_ = 0;
+    int gen_spl_ = 0;
+    // of the step in progress, as requested for its level
+    float gen_amplitude_ = 0;
+    unsigned gen_index_ = 0;
+    int gen_window_ = Analysis::Window_Hann;
+    unsigned gen_averages_ = 1;
+
+    // the most bins or points of any request, which sizes the storage
+    unsigned max_count_ = 0;
 
     unsigned gen_num_bins_ = 0;
-    float gen_freq_[Analysis::max_bins_at_once] = {};
-    float gen_phase_[Analysis::max_bins_at_once] = {};
-    float gen_starting_phase_[Analysis::max_bins_at_once] = {};
+    std::unique_ptr<float[]> gen_freq_;
+    Osc_Bank gen_osc_;
+    std::unique_ptr<float[]> gen_phase_;
+    std::unique_ptr<float[]> gen_starting_phase_;
     float gen_gain_compensate_ = 0;
+    // input samples skipped before the capture, to reach the steady state
+    // and then to cover the latency, of which the reference of the phases
+    // only counts the former
+    unsigned gen_settle_ = 0;
+    unsigned gen_reference_ = 0;
+
+    std::atomic<unsigned> latency_{0};
+
+    // settling model: the energy decay curve of the impulse response which
+    // is measured with the latency, and the time in which it decays by the
+    // margin, zero without a model; the curve is shared by the worker and
+    // the setter of the margin, never by the audio thread
+    std::mutex settle_mutex_;
+    std::unique_ptr<float[]> settle_edc_;
+    unsigned settle_edc_len_ = 0;
+    float settle_margin_ = Analysis::settle_margin_default;
+    std::atomic<unsigned> settle_decay_{0};
+    std::atomic<bool> crossfade_enable_{true};
+    // samples of silent output, through which the last step has decayed
+    unsigned silence_ = 0;
+
+    // cross-fade from the tones of the previous step, kept in the other bank,
+    // or if the tones are the same, ramp from the level of the previous step
+    bool gen_crossfade_ = false;
+    bool fade_level_ = false;
+    Osc_Bank fade_osc_;
+    float fade_gain_ = 0;
+    unsigned fade_pos_ = 0;
+    unsigned fade_len_ = 0;
+
+    // sweep plan, walked by the audio thread: the position of the step to
+    // request next, and the steps to repeat before it; a new plan or a stop
+    // changes the serial, which invalidates the step being designed, and
+    // the steps are measured for the serial of the plan request
+    enum { plan_repeats_max = 16 };
+    struct Plan_Step {
+        int spl;
+        unsigned index;
+    };
+
+    bool plan_active_ = false;
+    unsigned plan_serial_ = 0;
+    unsigned plan_request_serial_ = 0;
+    unsigned plan_num_levels_ = 0;
+    float plan_amplitude_[Analysis::levels_max] = {};
+    int plan_window_ = Analysis::Window_Hann;
+    unsigned plan_averages_ = 1;
+    unsigned plan_num_bins_ = 0;
+    unsigned plan_num_points_ = 0;
+    std::unique_ptr<float[]> plan_freq_;
+    Plan_Step plan_next_ = {};
+    Plan_Step plan_repeat_[plan_repeats_max];
+    unsigned plan_num_repeats_ = 0;
+
+    // the step which follows the one in progress, requested by the audio
+    // thread and designed by the worker meanwhile, so that it starts as
+    // soon as the capture of the previous one is complete; the state tells
+    // which of them the slot belongs to
+    enum Slot_State { Slot_Free, Slot_Pending, Slot_Ready };
+    struct Step_Slot {
+        std::atomic<int> state{Slot_Free};
+        unsigned serial = 0;
+        Plan_Step step = {};
+        unsigned num_bins = 0;
+        std::unique_ptr<unsigned[]> bins;
+        std::unique_ptr<float[]> frequency;
+        std::unique_ptr<float[]> phase;
+        float gain = 1;
+    };
 
-    std::unique_ptr<float[]> out_buf_;
+    Step_Slot step_slot_;
+    std::unique_ptr<Multitone_Designer> multitone_;
+
+    // capture double-buffer, filled by the audio thread and analyzed by
+    // the worker; `pending` is set while the slot belongs to the worker;
+    // the buffers and the sparse spectra are laid out channel by channel;
+    // a stepped capture spans its frames, `hop` apart
+    struct Capture {
+        std::unique_ptr<float[]> buf;
+        std::atomic<bool> pending{false};
+        int mode = Analysis::Mode_Stepped;
+        bool calibrate = false;
+        bool emulated = false;
+        unsigned serial = 0;
+        int spl = 0;
+        unsigned index = 0;
+        int window = Analysis::Window_Hann;
+        unsigned averages = 1;
+        unsigned hop = 0;
+        unsigned num_bins = 0;
+        bool sparse = false;
+        std::unique_ptr<cdouble[]> spectrum;
+        std::unique_ptr<float[]> freq;
+        std::unique_ptr<float[]> starting_phase;
+        float amplitude = 0;
+    };
+
+    Capture capture_[2];
+    unsigned capture_index_ = 0;
     unsigned out_buf_len_ = 0;
     unsigned out_buf_fill_ = 0;
 
-    struct Fftwf_Deleter {
-        void operator()(void *x) { fftwf_free(x); }
-    };
-    struct Fftwf_Plan_Deleter {
-        void operator()(fftwf_plan x) { fftwf_destroy_plan(x); }
+    // sparse analysis, accumulated in the audio thread as samples arrive,
+    // per channel
+    bool sparse_ = false;
+    std::unique_ptr<unsigned[]> sparse_bin_;
+    std::unique_ptr<cdouble[]> sparse_acc_;
+    std::unique_ptr<float[]> twiddle_;
+
+    // exponential sine sweep, with its capture handed to the worker
+    std::unique_ptr<Sweep_Analyzer> ess_;
+    unsigned ess_pos_ = 0;
+    unsigned ess_num_points_ = 0;
+    std::unique_ptr<float[]> ess_freq_;
+
+    struct Sweep_Capture {
+        std::unique_ptr<float[]> buf;
+        std::atomic<bool> pending{false};
+        unsigned serial = 0;
+        int spl = 0;
+        unsigned num_points = 0;
+        std::unique_ptr<float[]> freq;
+        float amplitude = 0;
     };
 
+    Sweep_Capture ess_capture_;
+
+    // maximum-length sequence, with its capture in the stepped slots
+    std::unique_ptr<Mls_Analyzer> mls_;
+    unsigned mls_pos_ = 0;
+    bool mls_calibrate_ = false;
+
+    // notifications, composed by the worker in place in the ring buffer,
+    // except the latency which is small enough to be copied
+    Messages::NotifyLatency notify_latency_;
+
+    std::thread analysis_thread_;
+    sem_t analysis_sem_;
+    std::atomic<bool> analysis_quit_{false};
+
     std::unique_ptr<float[], Fftwf_Deleter> fft_real_;
     std::unique_ptr<cfloat[], Fftwf_Deleter> fft_cplx_;
     std::unique_ptr<fftwf_plan_s, Fftwf_Plan_Deleter> fft_plan_;
+
+    // sums over the frames, of the response and of its squared magnitude,
+    // which are the cross-spectrum and the auto-spectrum of the capture
+    // divided by the auto-spectrum of the excitation
+    std::unique_ptr<cdouble[]> avg_cross_;
+    std::unique_ptr<double[]> avg_power_;
+
+    // emulation: the bank of the model in use belongs to the audio thread,
+    // and the other one to the caller, who prepares it and hands it over by
+    // the flag, which the audio thread clears when it has switched; the
+    // output of the model is kept for the capture of the next period, a
+    // round trip without latency, in place of the latency of the device,
+    // which is left as it is
+    struct Emulation_Bank {
+        int mode = Analysis::Emulation_Live;
+        std::unique_ptr<Partitioned_Convolver[]> fir;
+        std::unique_ptr<Iir_Filter[]> iir;
+    };
+
+    Emulation_Bank emu_bank_[2];
+    std::atomic<unsigned> emu_active_{0};
+    std::atomic<bool> emu_pending_{false};
+    bool emulating_ = false;
+    std::unique_ptr<float[]> emu_return_;
+    std::unique_ptr<const float *[]> emu_return_ptr_;
+    std::unique_ptr<fftwf_plan_s, Fftwf_Plan_Deleter> emu_plan_forward_;
+    std::unique_ptr<fftwf_plan_s, Fftwf_Plan_Deleter> emu_plan_backward_;
+
+    std::unique_ptr<float[], Fftwf_Deleter> window_[Analysis::Window_Function_Count];
+    float window_factor_[Analysis::Window_Function_Count] = {};
+    // the sum of squares, and the half-width in bins of the main lobe over
+    // which a tone spreads
+    float window_energy_[Analysis::Window_Function_Count] = {};
+    unsigned window_lobe_[Analysis::Window_Function_Count] = {};
 };
 
 Audio_Processor::Audio_Processor()
@@ -75,31 +312,139 @@ Audio_Processor::Audio_Processor()
 {
     const float sr = Analysis::sample_rate;
 
-    P->in_amp_follower_.release(50e-3f * sr);
+    const unsigned channels = std::max(1u, std::min<unsigned>(Analysis::num_channels, Analysis::channels_max));
+    P->channels_ = channels;
+
+    P->in_amp_follower_.reset(new Amp_Follower<float>[channels]);
+    P->in_amp_channel_.reset(new float[channels]());
+    for (unsigned c = 0; c < channels; ++c)
+        P->in_amp_follower_[c].release(50e-3f * sr);
     P->out_amp_follower_.release(50e-3f * sr);
 
-    P->rb_in_.reset(new Ring_Buffer(8192));
-    P->rb_out_.reset(new Ring_Buffer(8192));
-    P->rb_in_buf_.reset(Messages::allocate_buffer());
-    P->rb_out_buf_.reset(Messages::allocate_buffer());
+    const unsigned max_count = std::max<unsigned>(Analysis::max_bins_at_once, Analysis::sweep_length_max);
+    P->max_count_ = max_count;
+
+    const size_t rb_size = std::max<size_t>(65536, 4 * Messages::max_size_of(max_count, channels));
+    P->rb_in_.reset(new Ring_Buffer(Messages::ring_capacity(rb_size)));
+    P->rb_out_.reset(new Ring_Buffer(Messages::ring_capacity(rb_size)));
+    P->rb_in_buf_.reset(Messages::allocate_buffer(max_count, channels));
+    P->rb_worker_buf_.reset(Messages::allocate_buffer(max_count, channels));
+    P->rb_out_buf_.reset(Messages::allocate_buffer(max_count, channels));
 
     const unsigned fft_size = nextpow2(std::ceil(0.5f * sr));
 
+    P->gen_freq_.reset(new float[max_count]());
+    P->gen_osc_.allocate(max_count);
+    P->fade_osc_.allocate(max_count);
+    P->fade_len_ = std::max(1.0f, Analysis::crossfade_duration * sr);
+    P->gen_phase_.reset(new float[max_count]());
+    P->gen_starting_phase_.reset(new float[max_count]());
+    P->sparse_bin_.reset(new unsigned[max_count]());
+    P->sparse_acc_.reset(new cdouble[channels * max_count]());
+    P->ess_freq_.reset(new float[max_count]());
+
+    P->plan_freq_.reset(new float[max_count]());
+    P->step_slot_.bins.reset(new unsigned[max_count]());
+    P->step_slot_.frequency.reset(new float[max_count]());
+    P->step_slot_.phase.reset(new float[max_count]());
+    P->multitone_.reset(new Multitone_Designer(fft_size));
+
     P->out_buf_len_ = fft_size;
-    P->out_buf_.reset(new float[fft_size]);
+    for (Impl::Capture &cap : P->capture_) {
+        cap.buf.reset(new float[channels * fft_size * Analysis::averages_max]);
+        cap.spectrum.reset(new cdouble[channels * max_count]());
+        cap.freq.reset(new float[max_count]());
+        cap.starting_phase.reset(new float[max_count]());
+    }
 
-    P->fft_real_.reset(fftwf_alloc_real(fft_size));
-    P->fft_cplx_.reset((cfloat *)fftwf_alloc_complex(fft_size / 2 + 1));
+    float *twiddle = new float[fft_size];
+    P->twiddle_.reset(twiddle);
+    for (unsigned i = 0; i < fft_size; ++i)
+        twiddle[i] = std::cos(2 * M_PI * i / fft_size);
+
+    // the channels transformed in a batch, each to its own spectrum
+    const int fft_n = fft_size;
+    const unsigned fft_bins = fft_size / 2 + 1;
+    P->fft_real_.reset(fftwf_alloc_real(channels * fft_size));
+    P->fft_cplx_.reset((cfloat *)fftwf_alloc_complex(channels * fft_bins));
     if (!P->fft_real_ || !P->fft_cplx_)
         throw std::bad_alloc();
 
-    P->fft_plan_.reset(fftwf_plan_dft_r2c_1d(fft_size, P->fft_real_.get(), (fftwf_complex *)P->fft_cplx_.get(), FFTW_MEASURE));
+    P->fft_plan_.reset(fftwf_plan_many_dft_r2c(
+        1, &fft_n, channels,
+        P->fft_real_.get(), nullptr, 1, fft_size,
+        (fftwf_complex *)P->fft_cplx_.get(), nullptr, 1, fft_bins, FFTW_MEASURE));
     if (!P->fft_plan_)
         throw std::bad_alloc();
+
+    // the transforms of the partitions of the emulation, of which the
+    // convolvers share the plans
+    {
+        const unsigned block = Partitioned_Convolver::block;
+        std::unique_ptr<float[], Fftwf_Deleter> real(fftwf_alloc_real(2 * block));
+        std::unique_ptr<fftwf_complex[], Fftwf_Deleter> cplx(fftwf_alloc_complex(block + 1));
+        if (!real || !cplx)
+            throw std::bad_alloc();
+        P->emu_plan_forward_.reset(fftwf_plan_dft_r2c_1d(2 * block, real.get(), cplx.get(), FFTW_MEASURE));
+        P->emu_plan_backward_.reset(fftwf_plan_dft_c2r_1d(2 * block, cplx.get(), real.get(), FFTW_MEASURE));
+        if (!P->emu_plan_forward_ || !P->emu_plan_backward_)
+            throw std::bad_alloc();
+    }
+    P->emu_return_.reset(new float[channels * Analysis::emulation_period_max]());
+    P->emu_return_ptr_.reset(new const float *[channels]);
+    for (unsigned c = 0; c < channels; ++c)
+        P->emu_return_ptr_[c] = &P->emu_return_[c * Analysis::emulation_period_max];
+
+    P->avg_cross_.reset(new cdouble[channels * max_count]());
+    P->avg_power_.reset(new double[channels * max_count]());
+
+    for (unsigned wf = 0; wf < Analysis::Window_Function_Count; ++wf) {
+        float *window = fftwf_alloc_real(fft_size);
+        if (!window)
+            throw std::bad_alloc();
+        P->window_[wf].reset(window);
+        unsigned lobe = 0;
+        switch (wf) {
+        case Analysis::Window_Hann:
+            hann_window(window, fft_size); lobe = 2; break;
+        case Analysis::Window_Blackman_Harris:
+            blackman_harris_window(window, fft_size); lobe = 4; break;
+        case Analysis::Window_Flat_Top:
+            flat_top_window(window, fft_size); lobe = 5; break;
+        case Analysis::Window_Rectangular:
+            rectangular_window(window, fft_size); lobe = 0; break;
+        }
+        P->window_factor_[wf] = window_amplitude_factor(window, fft_size);
+        double energy = 0;
+        for (unsigned i = 0; i < fft_size; ++i)
+            energy += window[i] * window[i];
+        P->window_energy_[wf] = energy;
+        P->window_lobe_[wf] = lobe;
+    }
+
+    P->ess_.reset(new Sweep_Analyzer(sr, Analysis::freq_range_min, Analysis::freq_range_max, Analysis::ess_duration, fft_size));
+    P->ess_capture_.buf.reset(new float[channels * P->ess_->capture_length()]);
+    P->ess_capture_.freq.reset(new float[max_count]());
+
+    // one period of sequence fits the capture buffer
+    unsigned mls_order = 0;
+    while ((2u << mls_order) <= fft_size)
+        ++mls_order;
+    P->mls_.reset(new Mls_Analyzer(sr, mls_order));
+    P->settle_edc_.reset(new float[P->mls_->length()]);
+
+    if (sem_init(&P->analysis_sem_, 0, 0) != 0)
+        throw std::system_error(errno, std::generic_category());
+    P->analysis_thread_ = std::thread([this]() { P->analysis_thread(); });
 }
 
 Audio_Processor::~Audio_Processor()
 {
+    P->analysis_quit_ = true;
+    sem_post(&P->analysis_sem_);
+    P->out_space_event_.signal();
+    P->analysis_thread_.join();
+    sem_destroy(&P->analysis_sem_);
 }
 
 void Audio_Processor::start()
@@ -108,11 +453,90 @@ void Audio_Processor::start()
     sys.start(&Impl::process, this);
 }
 
+void Audio_Processor::process(const float *const *in, float *const *out, unsigned n)
+{
+    Impl::process(in, out, n, this);
+}
+
 unsigned Audio_Processor::fft_size() const
 {
     return P->out_buf_len_;
 }
 
+unsigned Audio_Processor::num_channels() const
+{
+    return P->channels_;
+}
+
+unsigned Audio_Processor::latency() const
+{
+    return P->latency_.load(std::memory_order_relaxed);
+}
+
+void Audio_Processor::set_latency(unsigned latency)
+{
+    P->latency_.store(latency, std::memory_order_relaxed);
+}
+
+void Audio_Processor::set_settle_margin(float margin)
+{
+    std::lock_guard<std::mutex> lock(P->settle_mutex_);
+    P->settle_margin_ = margin;
+    P->compute_settling();
+}
+
+void Audio_Processor::set_crossfade(bool enable)
+{
+    P->crossfade_enable_.store(enable, std::memory_order_relaxed);
+}
+
+bool Audio_Processor::set_emulation_live(int timeout_ms)
+{
+    Impl::Emulation_Bank *bank = P->emulation_bank(timeout_ms);
+    if (!bank)
+        return false;
+    P->publish_emulation(*bank, Analysis::Emulation_Live);
+    return true;
+}
+
+bool Audio_Processor::set_emulation_fir(const float *const *ir, unsigned length, int timeout_ms)
+{
+    Impl::Emulation_Bank *bank = P->emulation_bank(timeout_ms);
+    if (!bank)
+        return false;
+
+    const unsigned channels = P->channels_;
+    if (!bank->fir) {
+        bank->fir.reset(new Partitioned_Convolver[channels]);
+        for (unsigned c = 0; c < channels; ++c)
+            bank->fir[c].allocate(Analysis::emulation_fir_length, P->emu_plan_forward_.get(), P->emu_plan_backward_.get());
+    }
+    for (unsigned c = 0; c < channels; ++c)
+        bank->fir[c].set_impulse(ir[c], length);
+
+    P->publish_emulation(*bank, Analysis::Emulation_Fir);
+    return true;
+}
+
+bool Audio_Processor::set_emulation_iir(const double *const *b, unsigned nb, const double *const *a, unsigned na, int timeout_ms)
+{
+    Impl::Emulation_Bank *bank = P->emulation_bank(timeout_ms);
+    if (!bank)
+        return false;
+
+    const unsigned channels = P->channels_;
+    if (!bank->iir) {
+        bank->iir.reset(new Iir_Filter[channels]);
+        for (unsigned c = 0; c < channels; ++c)
+            bank->iir[c].allocate(Analysis::filter_order_max);
+    }
+    for (unsigned c = 0; c < channels; ++c)
+        bank->iir[c].set_coefficients(b[c], nb, a[c], na);
+
+    P->publish_emulation(*bank, Analysis::Emulation_Iir);
+    return true;
+}
+
 float Audio_Processor::input_level() const
 {
     return P->in_amp_;
@@ -123,112 +547,224 @@ float Audio_Processor::output_level() const
     return P->out_amp_;
 }
 
-void Audio_Processor::send_message(const Basic_Message &hmsg)
+bool Audio_Processor::send_message(const Basic_Message &hmsg, int timeout_ms)
 {
     Ring_Buffer &rb = *P->rb_in_;
-    while (!rb.put((uint8_t *)&hmsg, Messages::size_of(hmsg.tag)))
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    return Impl::wait_for_room(
+        P->in_space_event_, P->in_space_wanted_,
+        [&]() { return Messages::write(rb, hmsg); }, timeout_ms);
 }
 
 Basic_Message *Audio_Processor::receive_message()
 {
     Ring_Buffer &rb = *P->rb_out_;
-    Basic_Message *msg = (Basic_Message *)P->rb_out_buf_.get();
-
-    if (!rb.peek(*msg))
-        return nullptr;
+    uint8_t *buf = P->rb_out_buf_.get();
+    if (Basic_Message *held = P->rb_out_held_) {
+        Messages::release(rb, *held);
+        if (P->out_space_wanted_.exchange(false))
+            P->out_space_event_.signal();
+    }
 
-    size_t size = Messages::size_of(msg->tag);
-    if (rb.size_used() < size)
-        return nullptr;
+    // clear the wakeup before finding the queue empty, so that no
+    // notification posted meanwhile goes unsignaled
+    Basic_Message *msg = Messages::read_in_place(rb, buf);
+    if (!msg) {
+        P->out_event_.clear();
+        msg = Messages::read_in_place(rb, buf);
+    }
+    return P->rb_out_held_ = msg;
+}
 
-    rb.get((uint8_t *)msg, size);
-    return msg;
+int Audio_Processor::notification_fd() const
+{
+    return P->out_event_.fd();
 }
 
-void Audio_Processor::Impl::process(const float *in, float *out, unsigned n, void *userdata)
+void Audio_Processor::Impl::process(const float *const *in, float *const *out, unsigned n, void *userdata)
 {
     Audio_Processor *self = (Audio_Processor *)userdata;
     Impl *P = self->P.get();
 
-    std::fill_n(out, n, 0);
+    std::fill_n(out[0], n, 0);
+
+    // a new model of the device, of which the return starts silent
+    if (P->emu_pending_.load(std::memory_order_acquire)) {
+        P->emu_active_.store(P->emu_active_.load(std::memory_order_relaxed) ^ 1, std::memory_order_relaxed);
+        std::fill_n(P->emu_return_.get(), P->channels_ * Analysis::emulation_period_max, 0.0f);
+        P->emu_pending_.store(false, std::memory_order_release);
+    }
+
+    // the input is the return of the model, when it replaces the device;
+    // known before the requests, which are timed by the round trip
+    const Impl::Emulation_Bank &bank = P->emu_bank_[P->emu_active_.load(std::memory_order_relaxed)];
+    const bool emulating = bank.mode != Analysis::Emulation_Live && n <= Analysis::emulation_period_max;
+    P->emulating_ = emulating;
+    if (emulating)
+        in = P->emu_return_ptr_.get();
 
     P->handle_messages();
 
+    // the first step of the plan, which starts from silence
+    if (P->plan_active_ && !P->active_)
+        P->next_step();
+
     if (P->active_) {
         if (P->gen_can_start_) {
             P->collect(in, n);
-            if (!P->gen_has_finished_ && P->out_buf_fill_ == P->out_buf_len_) {
-                Ring_Buffer &rb_out = *P->rb_out_;
-                Messages::NotifyFrequencyAnalysis msg;
-                if (sizeof(msg) < rb_out.size_free()) {
-                    msg.spl = P->gen_spl_;
-                    msg.num_bins = P->gen_num_bins_;
-                    P->compute_response(msg.response);
-                    for (unsigned a = 0; a < msg.num_bins; ++a)
-                        msg.frequency[a] = P->gen_freq_[a] * Analysis::sample_rate;
-                    rb_out.put(msg);
-                    P->gen_has_finished_ = true;
-                }
+            if (!P->gen_has_finished_ && P->capture_complete()) {
+                P->submit_capture();
+                P->gen_has_finished_ = true;
             }
         }
 
-        if (!P->gen_can_start_ && P->out_amp_ < Analysis::silence_threshold) {
-            P->gen_can_start_ = true;
-            for (unsigned a = 0, num_bins = P->gen_num_bins_; a < num_bins; ++a)
-                P->gen_starting_phase_[a] = P->gen_phase_[a];
-        }
+        // the next step of the plan, as soon as it is designed
+        if (P->plan_active_ && P->gen_has_finished_)
+            P->next_step();
+
+        if (!P->gen_can_start_ && P->capture_available() && P->settled())
+            P->start_generator();
 
         if (P->gen_can_start_)
-            P->generate(out, n);
+            P->generate(out[0], n);
     }
 
-    P->update_levels(in, out, n);
+    for (unsigned c = 1, channels = P->channels_; c < channels; ++c)
+        std::copy_n(out[0], n, out[c]);
+
+    if (P->active_ && P->gen_can_start_)
+        P->silence_ = 0;
+    else
+        P->silence_ = std::min(P->silence_ + n, 1u << 30);
+
+    P->update_levels(in, out[0], n);
+
+    if (emulating)
+        P->emulate(out, n);
 }
 
 void Audio_Processor::Impl::handle_messages()
 {
     Ring_Buffer &rb_in = *rb_in_;
-    Basic_Message *hmsg = (Basic_Message *)rb_in_buf_.get();
-    while (rb_in.peek(*hmsg)) {
-        size_t size = Messages::size_of(hmsg->tag);
-        if (rb_in.size_used() < size)
-            break;
-        rb_in.get((uint8_t *)hmsg, size);
-        process_message(*hmsg);
+    uint8_t *buf = rb_in_buf_.get();
+    bool released = false;
+    while (Basic_Message *msg = Messages::read_in_place(rb_in, buf)) {
+        process_message(*msg);
+        Messages::release(rb_in, *msg);
+        released = true;
     }
+
+    // a non-blocking write, only if a sender waits
+    if (released && in_space_wanted_.exchange(false))
+        in_space_event_.signal();
 }
 
 void Audio_Processor::Impl::process_message(const Basic_Message &hmsg)
 {
-    float sr = Analysis::sample_rate;
-    unsigned fft_size = out_buf_len_;
-
     switch (hmsg.tag) {
     case Message_Tag::RequestAnalyzeFrequency: {
         auto *msg = (Messages::RequestAnalyzeFrequency *)&hmsg;
+        stop_plan();
+        arm_step(msg->serial, msg->spl, msg->amplitude, msg->index, msg->window, msg->averages,
+                 msg->frequency(), msg->phase(), msg->num_bins, msg->gain);
+        break;
+    }
+    case Message_Tag::RequestSweepPlan: {
+        auto *msg = (Messages::RequestSweepPlan *)&hmsg;
+        stop_plan();
+        // silent until the first step is designed
+        active_ = false;
+        plan_active_ = true;
+        plan_request_serial_ = msg->serial;
+        plan_num_levels_ = std::max(1u, std::min<unsigned>(msg->num_levels, Analysis::levels_max));
+        std::copy_n(msg->amplitude, plan_num_levels_, plan_amplitude_);
+        plan_window_ = msg->window;
+        plan_averages_ = msg->averages;
+        unsigned num_points = plan_num_points_ = std::max(1u, std::min(msg->num_points, max_count_));
+        plan_num_bins_ = std::max(1u, std::min(msg->num_bins, num_points));
+        std::copy_n(msg->frequency(), num_points, plan_freq_.get());
+        plan_next_.spl = ((unsigned)msg->first_spl < plan_num_levels_) ? msg->first_spl : 0;
+        plan_next_.index = msg->first_index % num_points;
+        break;
+    }
+    case Message_Tag::RequestRepeatStep: {
+        auto *msg = (Messages::RequestRepeatStep *)&hmsg;
+        // if there are too many, the step waits for the next round
+        if (plan_active_ && msg->serial == plan_request_serial_ &&
+            plan_num_repeats_ < plan_repeats_max && (unsigned)msg->spl < plan_num_levels_)
+            plan_repeat_[plan_num_repeats_++] = Plan_Step{msg->spl, msg->index};
+        break;
+    }
+    case Message_Tag::RequestAnalyzeSweep: {
+        auto *msg = (Messages::RequestAnalyzeSweep *)&hmsg;
+        stop_plan();
         active_ = true;
+        mode_ = Analysis::Mode_Sweep;
         gen_can_start_ = false;
         gen_has_finished_ = false;
+        gen_serial_ = msg->serial;
         gen_spl_ = msg->spl;
-        unsigned num_bins = gen_num_bins_ = msg->num_bins;
-        for (unsigned a = 0; a < num_bins; ++a) {
-            unsigned bin = std::lround(fft_size * msg->frequency[a] / sr);
-            bin = std::min(bin, fft_size / 2);
-            gen_freq_[a] = (float)bin / fft_size;
-            gen_phase_[a] = 0;
-            gen_starting_phase_[a] = 0;
-        }
+        gen_amplitude_ = msg->amplitude;
+        unsigned num_points = ess_num_points_ = std::min(msg->num_points, max_count_);
+        std::copy_n(msg->frequency(), num_points, ess_freq_.get());
+        gen_reference_ = 0;
+        gen_settle_ = round_trip();
+        gen_crossfade_ = false;
+        fade_pos_ = fade_len_;
+        ess_pos_ = 0;
         out_buf_fill_ = 0;
-
-        // compensate for level increase caused by sum of sines
-        float rms_single = M_SQRT1_2;
-        float rms_sum = sqrt((M_SQRT1_2 * M_SQRT1_2) * num_bins);
-        gen_gain_compensate_ = rms_single / rms_sum;
-
+        break;
+    }
+    case Message_Tag::RequestAnalyzeMls: {
+        auto *msg = (Messages::RequestAnalyzeMls *)&hmsg;
+        stop_plan();
+        active_ = true;
+        mode_ = Analysis::Mode_Mls;
+        gen_can_start_ = false;
+        gen_has_finished_ = false;
+        gen_serial_ = msg->serial;
+        gen_spl_ = msg->spl;
+        gen_amplitude_ = msg->amplitude;
+        unsigned num_points = gen_num_bins_ = std::min(msg->num_points, max_count_);
+        const float *frequency = msg->frequency();
+        for (unsigned i = 0; i < num_points; ++i)
+            gen_freq_[i] = frequency[i] / Analysis::sample_rate;
+        mls_pos_ = 0;
+        mls_calibrate_ = false;
+        out_buf_fill_ = 0;
+        sparse_ = false;
+        gen_gain_compensate_ = 1;
+        gen_crossfade_ = false;
+        fade_pos_ = fade_len_;
+        // capture after one period, when the response is circular
+        gen_reference_ = mls_->length();
+        gen_settle_ = gen_reference_ + round_trip();
+        break;
+    }
+    case Message_Tag::RequestMeasureLatency: {
+        auto *msg = (Messages::RequestMeasureLatency *)&hmsg;
+        stop_plan();
+        active_ = true;
+        mode_ = Analysis::Mode_Mls;
+        gen_can_start_ = false;
+        gen_has_finished_ = false;
+        gen_serial_ = msg->serial;
+        gen_spl_ = msg->spl;
+        gen_amplitude_ = msg->amplitude;
+        gen_num_bins_ = 0;
+        mls_pos_ = 0;
+        mls_calibrate_ = true;
+        out_buf_fill_ = 0;
+        sparse_ = false;
+        gen_gain_compensate_ = 1;
+        gen_crossfade_ = false;
+        fade_pos_ = fade_len_;
+        // the MLS measurement without compensation, of which the impulse
+        // response peaks at the latency
+        gen_reference_ = gen_settle_ = mls_->length();
         break;
     }
     case Message_Tag::RequestStop:
+        stop_plan();
         active_ = false;
         break;
     default:
@@ -237,80 +773,838 @@ void Audio_Processor::Impl::process_message(const Basic_Message &hmsg)
     }
 }
 
-void Audio_Processor::Impl::generate(float *out, unsigned n)
+void Audio_Processor::Impl::arm_step(unsigned serial, int spl, float amplitude, unsigned index, int window, unsigned averages, const float *frequency, const float *phase, unsigned num_bins, float gain)
 {
-    const float amp = Analysis::global_amplitude(gen_spl_);
+    const unsigned fft_size = out_buf_len_;
+    window = (window >= 0 && window < Analysis::Window_Function_Count) ?
+        window : Analysis::Window_Hann;
+    averages = std::max(1u, std::min<unsigned>(averages, Analysis::averages_max));
+    num_bins = std::min(num_bins, max_count_);
 
-    for (unsigned i = 0; i < n; ++i)
-        out[i] = 0;
+    // without a window, leakage vanishes only in the steady state
+    const unsigned reference = (window == Analysis::Window_Rectangular) ? fft_size / 4 : 0;
+    const unsigned settle = reference + round_trip();
+
+    // without silence: the same tones at another level go on in their bank,
+    // and the capture waits for the ramp to decay, counting from its end;
+    // other tones take the place of the previous ones, which fade out in
+    // the other bank, only if they will have decayed by the capture
+    const unsigned decay = settle_decay_.load(std::memory_order_relaxed);
+    const bool can_fade = active_ && gen_can_start_ && mode_ == Analysis::Mode_Stepped &&
+        crossfade_enable_.load(std::memory_order_relaxed) &&
+        decay > 0 && capture_available();
+    const bool same = can_fade && same_tones(frequency, phase, num_bins);
+    const bool fade = same || (can_fade && settle >= decay + fade_len_);
+    const unsigned ramp_wait = same ? (std::max(settle, decay + fade_len_) - settle) : 0;
+    if (fade) {
+        fade_gain_ = gen_amplitude_ * gen_gain_compensate_;
+        if (!same)
+            std::swap(gen_osc_, fade_osc_);
+    }
+    gen_crossfade_ = fade;
+    fade_level_ = same;
+    fade_pos_ = fade ? 0 : fade_len_;
 
-    unsigned num_bins = gen_num_bins_;
+    active_ = true;
+    mode_ = Analysis::Mode_Stepped;
+    gen_can_start_ = false;
+    gen_has_finished_ = false;
+    gen_serial_ = serial;
+    gen_spl_ = spl;
+    gen_amplitude_ = amplitude;
+    gen_index_ = index;
+    gen_window_ = window;
+    gen_averages_ = averages;
+    gen_num_bins_ = num_bins;
+    if (!same)
+        gen_osc_.reset(num_bins);
     for (unsigned a = 0; a < num_bins; ++a) {
-        const float f = gen_freq_[a];
-        float p = gen_phase_[a];
+        unsigned bin = Analysis::frequency_bin(frequency[a], fft_size);
+        gen_freq_[a] = (float)bin / fft_size;
+        if (!same) {
+            gen_osc_.frequency(a, (double)bin / fft_size);
+            gen_osc_.phase(a, phase[a]);
+            // a duplicate of the previous bin is measured, not generated
+            if (a > 0 && bin == sparse_bin_[a - 1])
+                gen_osc_.amplitude(a, 0);
+        }
+        gen_phase_[a] = phase[a];
+        gen_starting_phase_[a] = 0;
+        sparse_bin_[a] = bin;
+    }
+    std::fill_n(sparse_acc_.get(), channels_ * num_bins, 0);
+    out_buf_fill_ = 0;
+    // the sparse analysis is of a single frame
+    sparse_ = num_bins <= Analysis::sparse_max_bins && averages == 1;
+
+    // the phases are designed, by the requester or for the plan, and the
+    // gain which keeps the peak of the sum of tones to the peak of a single
+    // tone
+    gen_gain_compensate_ = gain;
+
+    gen_reference_ = reference + ramp_wait;
+    gen_settle_ = settle + ramp_wait;
+}
+
+void Audio_Processor::Impl::next_step()
+{
+    Step_Slot &slot = step_slot_;
+    int state = slot.state.load(std::memory_order_acquire);
+
+    // designed for a plan which is no more
+    if (state == Slot_Ready && slot.serial != plan_serial_) {
+        slot.state.store(Slot_Free, std::memory_order_relaxed);
+        state = Slot_Free;
+    }
+
+    if (state == Slot_Ready) {
+        arm_step(plan_request_serial_, slot.step.spl, plan_amplitude_[slot.step.spl], slot.step.index, plan_window_, plan_averages_,
+                 slot.frequency.get(), slot.phase.get(), slot.num_bins, slot.gain);
+        slot.state.store(Slot_Free, std::memory_order_relaxed);
+        state = Slot_Free;
+    }
+
+    // the following step is designed while this one is measured
+    if (state == Slot_Free)
+        request_step();
+}
+
+void Audio_Processor::Impl::request_step()
+{
+    Step_Slot &slot = step_slot_;
+    Plan_Step step;
+    if (plan_num_repeats_ > 0) {
+        step = plan_repeat_[0];
+        std::copy(plan_repeat_ + 1, plan_repeat_ + plan_num_repeats_, plan_repeat_);
+        --plan_num_repeats_;
+    }
+    else {
+        step = plan_next_;
+        if ((unsigned)++plan_next_.spl >= plan_num_levels_) {
+            plan_next_.spl = 0;
+            plan_next_.index = (plan_next_.index + 1) % plan_num_points_;
+        }
+    }
+
+    const unsigned fft_size = out_buf_len_;
+    const unsigned num_bins = plan_num_bins_;
+    const unsigned num_points = plan_num_points_;
+    slot.serial = plan_serial_;
+    slot.step = step;
+    slot.num_bins = num_bins;
+    for (unsigned a = 0; a < num_bins; ++a) {
+        unsigned src_index = Analysis::nth_bin_position(step.index % num_points, a, num_bins, num_points);
+        float frequency = slot.frequency[a] = plan_freq_[src_index];
+        slot.bins[a] = Analysis::frequency_bin(frequency, fft_size);
+    }
+
+    slot.state.store(Slot_Pending, std::memory_order_release);
+    sem_post(&analysis_sem_);
+}
+
+void Audio_Processor::Impl::stop_plan()
+{
+    // a step being designed is discarded when it is ready
+    plan_active_ = false;
+    plan_num_repeats_ = 0;
+    ++plan_serial_;
+}
+
+void Audio_Processor::Impl::generate(float *out, unsigned n)
+{
+    const float amp = gen_amplitude_;
+
+    if (mode_ == Analysis::Mode_Sweep) {
+        const float *signal = ess_->signal();
+        unsigned pos = ess_pos_;
+        unsigned count = std::min(n, ess_->signal_length() - pos);
+        for (unsigned i = 0; i < count; ++i)
+            out[i] = amp * signal[pos + i];
+        std::fill(out + count, out + n, 0);
+        ess_pos_ = pos + count;
+        return;
+    }
+
+    if (mode_ == Analysis::Mode_Mls) {
+        const float *signal = mls_->signal();
+        const unsigned len = mls_->length();
+        unsigned pos = mls_pos_;
         for (unsigned i = 0; i < n; ++i) {
-            out[i] += amp * std::cos(2 * (float)M_PI * p);
-            p += f;
-            p -= (int)p;
+            out[i] = amp * signal[pos];
+            pos = (pos + 1 < len) ? (pos + 1) : 0;
         }
-        gen_phase_[a] = p;
+        mls_pos_ = pos;
+        return;
     }
 
-    //
-    const float comp = gen_gain_compensate_;
-    for (unsigned i = 0; i < n; ++i)
-        out[i] *= comp;
+    const float gain = amp * gen_gain_compensate_;
+    gen_osc_.generate(out, n, gain);
+    if (fade_pos_ < fade_len_)
+        crossfade(out, n, gain);
 }
 
-void Audio_Processor::Impl::collect(const float *in, unsigned n)
+void Audio_Processor::Impl::crossfade(float *out, unsigned n, float gain)
 {
-    float *buf = out_buf_.get();
-    const unsigned len = out_buf_len_;
-    unsigned fill = out_buf_fill_;
+    // raised-cosine fade, in of the tones and out of the previous ones
+    enum { block_size = 256 };
+    float block[block_size];
+
+    n = std::min(n, fade_len_ - fade_pos_);
+
+    // the same tones, from the gain of the previous level
+    if (fade_level_) {
+        const float ratio = (gain > 0) ? (fade_gain_ / gain) : 1;
+        for (unsigned i = 0; i < n; ++i) {
+            float g = 0.5f - 0.5f * std::cos((float)M_PI * (fade_pos_ + i + 0.5f) / fade_len_);
+            out[i] *= g + (1 - g) * ratio;
+        }
+        fade_pos_ += n;
+        return;
+    }
+
+    for (unsigned offset = 0; offset < n;) {
+        const unsigned len = std::min<unsigned>(n - offset, block_size);
+        fade_osc_.generate(block, len, fade_gain_);
+        for (unsigned i = 0; i < len; ++i) {
+            float g = 0.5f - 0.5f * std::cos((float)M_PI * (fade_pos_ + i + 0.5f) / fade_len_);
+            out[offset + i] = g * out[offset + i] + (1 - g) * block[i];
+        }
+        fade_pos_ += len;
+        offset += len;
+    }
+}
+
+void Audio_Processor::Impl::collect(const float *const *in, unsigned n)
+{
+    const bool sweep = mode_ == Analysis::Mode_Sweep;
+    float *buf = sweep ? ess_capture_.buf.get() : capture_[capture_index_].buf.get();
+    const unsigned len = capture_length();
+    const unsigned fill = out_buf_fill_;
+
+    unsigned skip = std::min(n, gen_settle_);
+    gen_settle_ -= skip;
+    n -= skip;
 
     n = std::min(n, len - fill);
-    for (unsigned i = 0; i < n; ++i)
-        buf[fill++] = in[i];
+    for (unsigned c = 0, channels = channels_; c < channels; ++c) {
+        const float *src = in[c] + skip;
+        if (!sweep && sparse_)
+            accumulate_sparse(c, src, fill, n);
+        std::copy_n(src, n, &buf[c * len + fill]);
+    }
 
-    out_buf_fill_ = fill;
+    out_buf_fill_ = fill + n;
 }
 
-void Audio_Processor::Impl::compute_response(cfloat *response)
+void Audio_Processor::Impl::accumulate_sparse(unsigned channel, const float *in, unsigned pos, unsigned n)
+{
+    // windowed DFT of the requested bins, against the cosine table
+    // sin(2πm/N) = -cos(2π(m+N/4)/N), and the size N is a power of 2
+    const unsigned mask = out_buf_len_ - 1;
+    const unsigned quarter = out_buf_len_ / 4;
+    const float *window = window_[gen_window_].get() + pos;
+    const float *twiddle = twiddle_.get();
+    cdouble *acc = &sparse_acc_[channel * gen_num_bins_];
+
+    for (unsigned a = 0, num_bins = gen_num_bins_; a < num_bins; ++a) {
+        const unsigned k = sparse_bin_[a];
+        unsigned m = (k * pos) & mask;
+        double re = acc[a].real();
+        double im = acc[a].imag();
+        for (unsigned i = 0; i < n; ++i) {
+            float x = in[i] * window[i];
+            re += x * twiddle[m];
+            im += x * twiddle[(m + quarter) & mask];
+            m = (m + k) & mask;
+        }
+        acc[a] = cdouble(re, im);
+    }
+}
+
+void Audio_Processor::Impl::start_generator()
+{
+    gen_can_start_ = true;
+    if (mode_ != Analysis::Mode_Stepped)
+        return;
+    // the phase at the first sample captured, past the settling time
+    for (unsigned a = 0, num_bins = gen_num_bins_; a < num_bins; ++a) {
+        double p = gen_osc_.phase(a) + (double)gen_reference_ * gen_freq_[a];
+        gen_starting_phase_[a] = p - std::floor(p);
+    }
+}
+
+bool Audio_Processor::Impl::same_tones(const float *frequency, const float *phase, unsigned num_bins) const
+{
+    if (num_bins != gen_num_bins_)
+        return false;
+    for (unsigned a = 0; a < num_bins; ++a) {
+        if (Analysis::frequency_bin(frequency[a], out_buf_len_) != sparse_bin_[a] || phase[a] != gen_phase_[a])
+            return false;
+    }
+    return true;
+}
+
+bool Audio_Processor::Impl::settled() const
+{
+    if (gen_crossfade_)
+        return true;
+
+    const unsigned decay = settle_decay_.load(std::memory_order_relaxed);
+    if (decay == 0)
+        return out_amp_ < Analysis::silence_threshold;
+
+    // the residual decays through the silence, and then through the
+    // samples which are skipped before the capture
+    return silence_ + gen_settle_ >= decay;
+}
+
+unsigned Audio_Processor::Impl::round_trip() const
+{
+    return emulating_ ? 0 : latency_.load(std::memory_order_relaxed);
+}
+
+bool Audio_Processor::Impl::capture_available() const
+{
+    const std::atomic<bool> &pending = (mode_ == Analysis::Mode_Sweep) ?
+        ess_capture_.pending : capture_[capture_index_].pending;
+    return !pending.load(std::memory_order_acquire);
+}
+
+bool Audio_Processor::Impl::capture_complete() const
+{
+    return out_buf_fill_ == capture_length();
+}
+
+unsigned Audio_Processor::Impl::capture_length() const
+{
+    switch (mode_) {
+    case Analysis::Mode_Sweep:
+        return ess_->capture_length();
+    case Analysis::Mode_Mls:
+        return mls_->length();
+    default:
+        return out_buf_len_ + (gen_averages_ - 1) * frame_hop(gen_window_);
+    }
+}
+
+unsigned Audio_Processor::Impl::frame_hop(int window) const
+{
+    // unwindowed frames are independent only if they do not overlap
+    return (window == Analysis::Window_Rectangular) ? out_buf_len_ : out_buf_len_ / 2;
+}
+
+void Audio_Processor::Impl::submit_capture()
+{
+    if (mode_ == Analysis::Mode_Sweep) {
+        Sweep_Capture &cap = ess_capture_;
+        unsigned num_points = cap.num_points = ess_num_points_;
+        cap.serial = gen_serial_;
+        cap.spl = gen_spl_;
+        std::copy_n(ess_freq_.get(), num_points, cap.freq.get());
+        cap.amplitude = gen_amplitude_;
+        cap.pending.store(true, std::memory_order_release);
+        sem_post(&analysis_sem_);
+        return;
+    }
+
+    Capture &cap = capture_[capture_index_];
+
+    unsigned num_bins = cap.num_bins = gen_num_bins_;
+    cap.mode = mode_;
+    cap.calibrate = mode_ == Analysis::Mode_Mls && mls_calibrate_;
+    cap.emulated = emulating_;
+    cap.serial = gen_serial_;
+    cap.spl = gen_spl_;
+    cap.index = gen_index_;
+    cap.window = gen_window_;
+    cap.averages = (mode_ == Analysis::Mode_Stepped) ? gen_averages_ : 1;
+    cap.hop = frame_hop(gen_window_);
+    for (unsigned a = 0; a < num_bins; ++a) {
+        cap.freq[a] = gen_freq_[a];
+        cap.starting_phase[a] = gen_starting_phase_[a];
+    }
+    cap.amplitude = gen_amplitude_ * gen_gain_compensate_;
+    cap.sparse = sparse_;
+    if (sparse_)
+        std::copy_n(sparse_acc_.get(), channels_ * num_bins, cap.spectrum.get());
+
+    cap.pending.store(true, std::memory_order_release);
+    capture_index_ = (capture_index_ + 1) % 2;
+    sem_post(&analysis_sem_);
+}
+
+void Audio_Processor::Impl::analysis_thread()
+{
+    Ring_Buffer &rb_out = *rb_out_;
+    unsigned index = 0;
+
+    for (;;) {
+        while (sem_wait(&analysis_sem_) != 0 && errno == EINTR);
+        if (analysis_quit_)
+            break;
+
+        // the design of the next step is short, and precedes the analysis
+        if (step_slot_.state.load(std::memory_order_acquire) == Slot_Pending) {
+            design_step();
+            continue;
+        }
+
+        if (ess_capture_.pending.load(std::memory_order_acquire)) {
+            compute_sweep_response();
+            continue;
+        }
+
+        Capture &cap = capture_[index];
+        if (!cap.pending.load(std::memory_order_acquire))
+            continue;
+
+        if (cap.calibrate) {
+            compute_latency(cap);
+            cap.pending.store(false, std::memory_order_release);
+            index = (index + 1) % 2;
+            wait_for_room(out_space_event_, out_space_wanted_,
+                          [&]() { return analysis_quit_ || Messages::write(rb_out, notify_latency_); });
+            if (analysis_quit_)
+                break;
+            out_event_.signal();
+            continue;
+        }
+
+        if (cap.mode == Analysis::Mode_Mls) {
+            auto *msg = reserve_notification<Messages::NotifyMlsAnalysis>(cap.num_bins, channels_);
+            if (!msg)
+                break;
+            compute_mls_response(cap, *msg);
+            cap.pending.store(false, std::memory_order_release);
+            index = (index + 1) % 2;
+            post_notification(*msg);
+            continue;
+        }
+
+        compute_response(cap);
+
+        // a single tone has its harmonics apart from the other tones and
+        // their products, and then its distortion goes before the response
+        // which concludes the step
+        if (cap.num_bins == 1) {
+            auto *msg = reserve_notification<Messages::NotifyDistortion>(1, channels_);
+            if (!msg)
+                break;
+            compute_distortion(cap, *msg);
+            post_notification(*msg);
+        }
+
+        auto *msg = reserve_notification<Messages::NotifyFrequencyAnalysis>(cap.num_bins, channels_);
+        if (!msg)
+            break;
+        compose_response(cap, *msg);
+
+        cap.pending.store(false, std::memory_order_release);
+        index = (index + 1) % 2;
+
+        post_notification(*msg);
+    }
+}
+
+void Audio_Processor::Impl::post_notification(const Basic_Message &msg)
+{
+    Messages::commit(*rb_out_, msg);
+    out_event_.signal();
+}
+
+template <class T, class... Counts>
+T *Audio_Processor::Impl::reserve_notification(Counts... counts)
+{
+    // wait for the receiver to make room, or null if quitting
+    T *msg = nullptr;
+    wait_for_room(out_space_event_, out_space_wanted_, [&]() {
+        return analysis_quit_ || (msg = Messages::reserve<T>(*rb_out_, rb_worker_buf_.get(), counts...));
+    });
+    return analysis_quit_ ? nullptr : msg;
+}
+
+template <class Attempt>
+bool Audio_Processor::Impl::wait_for_room(Event_Fd &event, std::atomic<bool> &wanted, Attempt attempt, int timeout_ms)
+{
+    if (attempt())
+        return true;
+
+    typedef std::chrono::steady_clock clock;
+    const clock::time_point deadline = clock::now() + std::chrono::milliseconds(timeout_ms);
+
+    // ask for a wakeup before retrying, so that room made after the retry
+    // is signaled
+    for (;;) {
+        event.clear();
+        wanted.store(true);
+        if (attempt())
+            return true;
+
+        int wait_ms = -1;
+        if (timeout_ms >= 0) {
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - clock::now());
+            if (remaining.count() <= 0)
+                return false;
+            wait_ms = remaining.count();
+        }
+        event.wait(wait_ms);
+    }
+}
+
+void Audio_Processor::Impl::compute_sweep_response()
+{
+    Sweep_Capture &cap = ess_capture_;
+
+    auto *pmsg = reserve_notification<Messages::NotifySweepAnalysis>(cap.num_points, channels_);
+    if (!pmsg)
+        return;
+
+    Messages::NotifySweepAnalysis &msg = *pmsg;
+    msg.serial = cap.serial;
+    msg.spl = cap.spl;
+    msg.num_channels = channels_;
+    unsigned num_points = msg.num_points = cap.num_points;
+    std::copy_n(cap.freq.get(), num_points, msg.frequency());
+
+    const unsigned len = ess_->capture_length();
+    for (unsigned c = 0, channels = channels_; c < channels; ++c) {
+        cfloat *harmonics[Analysis::ess_num_harmonics];
+        for (unsigned h = 0; h < Analysis::ess_num_harmonics; ++h)
+            harmonics[h] = msg.harmonic(c, h);
+        ess_->analyze(
+            &cap.buf[c * len], cap.amplitude, cap.freq.get(), num_points,
+            msg.response(c), harmonics, Analysis::ess_num_harmonics);
+    }
+
+    cap.pending.store(false, std::memory_order_release);
+
+    post_notification(msg);
+}
+
+void Audio_Processor::Impl::design_step()
+{
+    Step_Slot &slot = step_slot_;
+    slot.gain = multitone_->design(slot.bins.get(), slot.num_bins, slot.phase.get());
+    slot.state.store(Slot_Ready, std::memory_order_release);
+}
+
+void Audio_Processor::Impl::compute_mls_response(const Capture &cap, Messages::NotifyMlsAnalysis &msg)
+{
+    msg.serial = cap.serial;
+    msg.spl = cap.spl;
+    msg.num_channels = channels_;
+    unsigned num_points = msg.num_points = cap.num_bins;
+    float *frequency = msg.frequency();
+    for (unsigned i = 0; i < num_points; ++i)
+        frequency[i] = cap.freq[i] * Analysis::sample_rate;
+    const unsigned len = mls_->length();
+    for (unsigned c = 0, channels = channels_; c < channels; ++c)
+        mls_->analyze(&cap.buf[c * len], cap.amplitude, frequency, num_points, msg.response(c));
+}
+
+void Audio_Processor::Impl::compute_latency(const Capture &cap)
+{
+    const unsigned len = mls_->length();
+
+    // the latency is taken on the channel of strongest response, and the
+    // energy decay curve is the slowest of all channels which respond; each
+    // curve is by backward integration, less the noise floor which is
+    // estimated on the last quarter of the response
+    std::lock_guard<std::mutex> lock(settle_mutex_);
+    float *edc = settle_edc_.get();
+    std::fill_n(edc, len, 0);
+    settle_edc_len_ = 0;
+
+    unsigned latency = 0;
+    double peak = 0;
+    double dominance = 0;
+    unsigned channel = 0;
+
+    for (unsigned c = 0, channels = channels_; c < channels; ++c) {
+        const double *ir = mls_->deconvolve(&cap.buf[c * len], cap.amplitude);
+
+        // the response is taken less its mean, which a DC offset of the
+        // capture or an even-order distortion spreads over all of it
+        double mean = 0;
+        for (unsigned k = 0; k < len; ++k)
+            mean += ir[k];
+        mean /= len;
+
+        unsigned channel_latency = 0;
+        double channel_peak = 0;
+        for (unsigned k = 0; k < len; ++k) {
+            double mag = std::abs(ir[k] - mean);
+            if (mag > channel_peak) {
+                channel_peak = mag;
+                channel_latency = k;
+            }
+        }
+
+        const unsigned tail = len - len / 4;
+        double noise = 0;
+        for (unsigned k = tail; k < len; ++k)
+            noise += (ir[k] - mean) * (ir[k] - mean);
+        noise /= len - tail;
+
+        if (channel_peak > peak) {
+            peak = channel_peak;
+            latency = channel_latency;
+            dominance = (noise > 0) ? (channel_peak / std::sqrt(noise)) : HUGE_VAL;
+            channel = c;
+        }
+
+        // an impulse response lost in the noise: nothing is connected
+        if (channel_peak <= Analysis::latency_min_peak)
+            continue;
+
+        double total = 0;
+        for (unsigned k = 0; k < len; ++k)
+            total += std::max(0.0, (ir[k] - mean) * (ir[k] - mean) - noise);
+        if (total <= 0)
+            continue;
+
+        double energy = 0;
+        for (unsigned k = len; k-- > 0;) {
+            energy += std::max(0.0, (ir[k] - mean) * (ir[k] - mean) - noise);
+            edc[k] = std::max<float>(edc[k], energy / total);
+        }
+        settle_edc_len_ = len;
+    }
+
+    // a peak which does not stand out of the tail is not of the delay, but
+    // of the noise or of a distortion which the deconvolution spreads
+    const bool valid = peak > Analysis::latency_min_peak &&
+        dominance >= Analysis::latency_min_dominance;
+
+    // the round trip of the model is not the latency of the device
+    if (!cap.emulated)
+        latency_.store(valid ? latency : 0, std::memory_order_relaxed);
+
+    notify_latency_.serial = cap.serial;
+    notify_latency_.latency = latency;
+    notify_latency_.peak = peak;
+    notify_latency_.channel = channel;
+    notify_latency_.valid = valid;
+
+    compute_settling();
+}
+
+void Audio_Processor::Impl::compute_settling()
+{
+    // the time for the residual energy to decay by the margin
+    const float *edc = settle_edc_.get();
+    const unsigned len = settle_edc_len_;
+    const float target = std::pow(10.0f, -0.1f * settle_margin_);
+
+    unsigned decay = 0;
+    if (len > 0) {
+        while (decay < len && edc[decay] > target)
+            ++decay;
+        decay = std::max(decay, 1u);
+    }
+
+    settle_decay_.store(decay, std::memory_order_relaxed);
+}
+
+// the sums over the frames, then composed into the notification; split so
+// that the distortion, which follows from the last transform, is sent first
+void Audio_Processor::Impl::compute_response(const Capture &cap)
 {
     const unsigned n = out_buf_len_;
+    const unsigned fft_bins = n / 2 + 1;
+    const unsigned channels = channels_;
+    const unsigned averages = cap.averages;
+    const unsigned len = n + (averages - 1) * cap.hop;
 
-    const float *raw = out_buf_.get();
+    const float *raw = cap.buf.get();
+    const float *window = window_[cap.window].get();
     float *real = fft_real_.get();
-    cfloat *cplx = fft_cplx_.get();
+    const cfloat *cplx = fft_cplx_.get();
+
+    unsigned num_bins = cap.num_bins;
+    cdouble *cross = avg_cross_.get();
+    double *power = avg_power_.get();
+    std::fill_n(cross, channels * num_bins, 0);
+    std::fill_n(power, channels * num_bins, 0);
+
+    // Welch's method over the frames: the excitation of a frame is known,
+    // being the tones advanced by the hop, so its auto-spectrum is that of
+    // the first frame and the cross-spectrum accumulates the response of
+    // each frame; a single tone has the whole spectrum for its distortion,
+    // even if the response is from the sparse analysis
+    for (unsigned m = 0; m < averages; ++m) {
+        const unsigned offset = m * cap.hop;
 
-    for (unsigned i = 0; i < n; ++i) {
-        float w = 0.5f * (1 - std::cos((2 * (float)M_PI * i) / (n - 1)));
-        real[i] = raw[i] * w;
+        if (!cap.sparse || num_bins == 1) {
+            for (unsigned c = 0; c < channels; ++c) {
+                for (unsigned i = 0; i < n; ++i)
+                    real[c * n + i] = raw[c * len + offset + i] * window[i];
+            }
+            fftwf_execute(fft_plan_.get());
+        }
+
+        for (unsigned c = 0; c < channels; ++c) {
+            for (unsigned a = 0; a < num_bins; ++a) {
+                const float f = cap.freq[a];
+                unsigned bin = std::lround(n * f);
+                cfloat spectrum = cap.sparse ?
+                    (cfloat)cap.spectrum[c * num_bins + a] : cplx[c * fft_bins + bin];
+                cfloat h_out = spectrum * window_factor_[cap.window];
+                double phase = cap.starting_phase[a] + (double)bin * offset / n;
+                cfloat h_in = std::polar(cap.amplitude, 2 * (float)M_PI * (float)(phase - std::floor(phase)));
+                cfloat h = h_out / h_in;
+                cross[c * num_bins + a] += (cdouble)h;
+                power[c * num_bins + a] += std::norm(h);
+            }
+        }
     }
+}
 
-    fftwf_execute(fft_plan_.get());
+void Audio_Processor::Impl::compose_response(const Capture &cap, Messages::NotifyFrequencyAnalysis &msg)
+{
+    const unsigned channels = channels_;
+    const unsigned averages = cap.averages;
+    unsigned num_bins = cap.num_bins;
+    const cdouble *cross = avg_cross_.get();
+    const double *power = avg_power_.get();
 
-    unsigned num_bins = gen_num_bins_;
-    for (unsigned a = 0; a < num_bins; ++a) {
-        const float f = gen_freq_[a];
-        unsigned bin = std::lround(n * f);
-        cfloat h_out = cplx[bin] * 4.0f / (float)n;
-        cfloat h_in = std::polar(
-            (float)Analysis::global_amplitude(gen_spl_) * gen_gain_compensate_,
-            2 * (float)M_PI * gen_starting_phase_[a]);
-        response[a] = h_out / h_in;
+    msg.serial = cap.serial;
+    msg.spl = cap.spl;
+    msg.index = cap.index;
+    msg.num_channels = channels;
+    msg.num_bins = num_bins;
+    float *frequency = msg.frequency();
+    for (unsigned a = 0; a < num_bins; ++a)
+        frequency[a] = cap.freq[a] * Analysis::sample_rate;
+
+    // the H1 estimate and the magnitude-squared coherence
+    for (unsigned c = 0; c < channels; ++c) {
+        cfloat *response = msg.response(c);
+        float *coherence = msg.coherence(c);
+        for (unsigned a = 0; a < num_bins; ++a) {
+            const cdouble sum = cross[c * num_bins + a];
+            const double sum_power = power[c * num_bins + a];
+            response[a] = sum * (1.0 / averages);
+            coherence[a] = (sum_power > 0) ? (std::norm(sum) / (averages * sum_power)) : 0;
+        }
     }
 }
 
-void Audio_Processor::Impl::update_levels(const float *in, float *out, unsigned n)
+void Audio_Processor::Impl::compute_distortion(const Capture &cap, Messages::NotifyDistortion &msg)
 {
-    float in_amp = in_amp_;
-    float out_amp = out_amp_;
+    // the spectrum of a single tone, as transformed for the last frame of
+    // the response: the harmonics fall on the multiples of its bin, the
+    // fundamental and the harmonics spread over the main lobe of the
+    // window, and the rest beyond DC is the noise
+    const unsigned n = out_buf_len_;
+    const unsigned fft_bins = n / 2 + 1;
+    const unsigned channels = channels_;
+    const unsigned lobe = window_lobe_[cap.window];
+    const double energy = window_energy_[cap.window];
+    const unsigned bin = std::max(1l, std::lround(n * cap.freq[0]));
+
+    msg.serial = cap.serial;
+    msg.spl = cap.spl;
+    msg.index = cap.index;
+    msg.num_channels = channels;
+    msg.num_bins = 1;
+    msg.frequency()[0] = cap.freq[0] * Analysis::sample_rate;
+
+    for (unsigned c = 0; c < channels; ++c) {
+        const cfloat *spectrum = &fft_cplx_[c * fft_bins];
+
+        double fundamental = 0;
+        double residual = 0;
+        double noise = 0;
+        unsigned noise_bins = 0;
+        for (unsigned k = 1; k < fft_bins; ++k) {
+            const unsigned order = (k + bin / 2) / bin;
+            const unsigned distance = (k > order * bin) ? (k - order * bin) : (order * bin - k);
+            const double power = std::norm(spectrum[k]);
+            if (order == 1 && distance <= lobe)
+                fundamental += power;
+            else if (k <= lobe)
+                continue;
+            else {
+                residual += power;
+                if (order < 2 || order > 1 + Analysis::distortion_num_harmonics || distance > lobe) {
+                    noise += power;
+                    ++noise_bins;
+                }
+            }
+        }
+
+        // the harmonics by their peaks, being on bins as the fundamental
+        cfloat *harmonic = msg.harmonic(c, 0);
+        const cfloat h1 = spectrum[bin];
+        const float m1 = std::abs(h1);
+        const cfloat u1 = (m1 > 0) ? std::conj(h1 / m1) : 0;
+        cfloat rotation = u1;
+        double sum = 0;
+        for (unsigned h = 0; h < Analysis::distortion_num_harmonics; ++h) {
+            const unsigned order = h + 2;
+            rotation *= u1;
+            cfloat value = 0;
+            if (m1 > 0 && order * bin < n / 2)
+                value = spectrum[order * bin] * rotation / m1;
+            harmonic[h] = value;
+            sum += std::norm(value);
+        }
 
-    for (unsigned i = 0; i < n; ++i) {
-        in_amp = in_amp_follower_.process(in[i]);
+        msg.thd(c)[0] = std::sqrt(sum);
+        msg.thdn(c)[0] = (fundamental > 0) ? std::sqrt(residual / fundamental) : 0;
+        msg.noise(c)[0] = (noise_bins > 0) ? std::sqrt(noise / (noise_bins * energy)) : 0;
+    }
+}
+
+Audio_Processor::Impl::Emulation_Bank *Audio_Processor::Impl::emulation_bank(int timeout_ms)
+{
+    // the other bank is free once the audio thread has switched to the last
+    for (int waited = 0; emu_pending_.load(std::memory_order_acquire); ++waited) {
+        if (timeout_ms >= 0 && waited >= timeout_ms)
+            return nullptr;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return &emu_bank_[emu_active_.load(std::memory_order_relaxed) ^ 1];
+}
+
+void Audio_Processor::Impl::publish_emulation(Emulation_Bank &bank, int mode)
+{
+    bank.mode = mode;
+    emu_pending_.store(true, std::memory_order_release);
+}
+
+void Audio_Processor::Impl::emulate(float *const *out, unsigned n)
+{
+    Emulation_Bank &bank = emu_bank_[emu_active_.load(std::memory_order_relaxed)];
+
+    // the model of each channel, from the generator in place in the outputs
+    for (unsigned c = 0, channels = channels_; c < channels; ++c) {
+        float *ret = &emu_return_[c * Analysis::emulation_period_max];
+        if (bank.mode == Analysis::Emulation_Fir)
+            bank.fir[c].process(out[c], ret, n);
+        else
+            bank.iir[c].process(out[c], ret, n);
+        std::copy_n(ret, n, out[c]);
+    }
+}
+
+void Audio_Processor::Impl::update_levels(const float *const *in, const float *out, unsigned n)
+{
+    // the input level is that of the loudest channel
+    float in_amp = 0;
+    for (unsigned c = 0, channels = channels_; c < channels; ++c) {
+        Amp_Follower<float> &follower = in_amp_follower_[c];
+        float amp = in_amp_channel_[c];
+        for (unsigned i = 0; i < n; ++i)
+            amp = follower.process(in[c][i]);
+        in_amp_channel_[c] = amp;
+        in_amp = std::max(in_amp, amp);
+    }
+
+    float out_amp = out_amp_;
+    for (unsigned i = 0; i < n; ++i)
         out_amp = out_amp_follower_.process(out[i]);
-    };
 
     in_amp_ = in_amp;
     out_amp_ = out_amp;
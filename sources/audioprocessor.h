@@ -13,13 +13,54 @@ public:
     ~Audio_Processor();
     void start();
 
+    // runs one period of the callback, for driving without a backend, with
+    // a buffer per channel
+    void process(const float *const *in, float *const *out, unsigned n);
+
     unsigned fft_size() const;
 
+    // the channels, captured at once and analyzed each to its own response,
+    // with the generator sent to all outputs alike
+    unsigned num_channels() const;
+
+    // round-trip latency in samples, by which the captures are delayed and
+    // the phases advanced; set by a RequestMeasureLatency from the channel
+    // of strongest response, or by hand; it is of the device, and is not in
+    // force nor measured while the device is emulated
+    unsigned latency() const;
+    void set_latency(unsigned latency);
+
+    // settling between steps, predicted from the impulse response measured
+    // with the latency: the next step waits until the residual of the
+    // previous one has decayed by the margin in dB, or fades in directly if
+    // enabled and there is nothing to wait for; without a measurement, the
+    // wait is for the silence of the output
+    void set_settle_margin(float margin);
+    void set_crossfade(bool enable);
+
+    // emulation of the device by a model of its response per channel, which
+    // the outputs play in place of the generator, and which the analysis
+    // captures a period later, as the round trip of a loopback; the model
+    // is a minimum-phase impulse response, convolved without latency, or a
+    // rational filter; it is prepared by the caller, and switched to at the
+    // next period, false if the last switch is still pending at the timeout
+    // in milliseconds, -1 for none
+    bool set_emulation_live(int timeout_ms = -1);
+    bool set_emulation_fir(const float *const *ir, unsigned length, int timeout_ms = -1);
+    bool set_emulation_iir(const double *const *b, unsigned nb, const double *const *a, unsigned na, int timeout_ms = -1);
+
     float input_level() const;
     float output_level() const;
 
-    void send_message(const Basic_Message &hmsg);
+    // blocking until there is room, or for the timeout in milliseconds, -1
+    // for none; false if timed out
+    bool send_message(const Basic_Message &hmsg, int timeout_ms = -1);
+
+    // the next notification, valid until the next call, or null; the
+    // descriptor is readable when there are notifications, for the event
+    // loop of the receiver, which then takes them all
     Basic_Message *receive_message();
+    int notification_fd() const;
 
 private:
     struct Impl;
@@ -4,7 +4,6 @@
 //          http://www.boost.org/LICENSE_1_0.txt)
 
 #include "audiosys.h"
-#include <QCoreApplication>
 
 Audio_Sys &Audio_Sys::instance()
 {
@@ -14,27 +13,6 @@ Audio_Sys &Audio_Sys::instance()
 
 Audio_Sys::Audio_Sys()
 {
-    QCoreApplication *app = QCoreApplication::instance();
-
-    jack_client_t *client = jack_client_open(
-        app->applicationName().toUtf8().data(),
-        JackNoStartServer, nullptr);
-    if (!client)
-        return;
-
-    client_.reset(client);
-
-    jack_port_t *in = jack_port_register(client, app->tr("Measurement input").toUtf8().data(), JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0);
-    jack_port_t *out = jack_port_register(client, app->tr("Generator output").toUtf8().data(), JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
-    if (!in || !out) {
-        client_.reset();
-        return;
-    }
-
-    in_ = in;
-    out_ = out;
-
-    jack_set_process_callback(client, &process, this);
 }
 
 Audio_Sys::~Audio_Sys()
@@ -43,38 +21,43 @@ Audio_Sys::~Audio_Sys()
 
 Audio_Sys::operator bool() const
 {
-    return client_ != nullptr;
+    return backend_ != nullptr;
 }
 
-float Audio_Sys::sample_rate() const
+void Audio_Sys::set_backend(std::unique_ptr<Audio_Backend> backend)
 {
-    return jack_get_sample_rate(client_.get());
+    if (backend_)
+        backend_->stop();
+    backend_ = std::move(backend);
 }
 
-void Audio_Sys::start(void (*fn)(const float *, float *, unsigned, void *), void *data)
+Audio_Backend *Audio_Sys::backend() const
 {
-    jack_client_t *client = client_.get();
-    jack_deactivate(client);
-    cb_fn_ = fn;
-    cb_data_ = data;
-    jack_activate(client);
+    return backend_.get();
 }
 
-void Audio_Sys::stop()
+float Audio_Sys::sample_rate() const
 {
-    jack_client_t *client = client_.get();
-    jack_deactivate(client);
+    return backend_->sample_rate();
 }
 
-int Audio_Sys::process(jack_nframes_t nframes, void *userdata)
+unsigned Audio_Sys::buffer_size() const
 {
-    Audio_Sys *self = (Audio_Sys *)userdata;
+    return backend_->buffer_size();
+}
 
-    const float *in = (float *)jack_port_get_buffer(self->in_, nframes);
-    float *out = (float *)jack_port_get_buffer(self->out_, nframes);
+unsigned Audio_Sys::num_channels() const
+{
+    return backend_->num_channels();
+}
 
-    if (self->cb_fn_)
-        self->cb_fn_(in, out, nframes, self->cb_data_);
+void Audio_Sys::start(Audio_Backend::Process_Fn *fn, void *data)
+{
+    backend_->start(fn, data);
+}
 
-    return 0;
+void Audio_Sys::stop()
+{
+    if (backend_)
+        backend_->stop();
 }
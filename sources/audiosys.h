@@ -3,7 +3,8 @@
 //    (See accompanying file LICENSE or copy at
 //          http://www.boost.org/LICENSE_1_0.txt)
 
-#include <jack/jack.h>
+#pragma once
+#include "audiobackend.h"
 #include <memory>
 
 class Audio_Sys {
@@ -17,21 +18,16 @@ public:
     ~Audio_Sys();
     explicit operator bool() const;
 
+    void set_backend(std::unique_ptr<Audio_Backend> backend);
+    Audio_Backend *backend() const;
+
     float sample_rate() const;
+    unsigned buffer_size() const;
+    unsigned num_channels() const;
 
-    void start(void (*fn)(const float *, float *, unsigned, void *), void *data);
+    void start(Audio_Backend::Process_Fn *fn, void *data);
     void stop();
 
 private:
-    struct Jack_Deleter {
-        void operator()(jack_client_t *x) { jack_client_close(x); }
-    };
-
-    std::unique_ptr<jack_client_t, Jack_Deleter> client_;
-    jack_port_t *in_ = nullptr;
-    jack_port_t *out_ = nullptr;
-    void (*cb_fn_)(const float *, float *, unsigned, void *) = nullptr;
-    void *cb_data_ = nullptr;
-
-    static int process(jack_nframes_t nframes, void *userdata);
+    std::unique_ptr<Audio_Backend> backend_;
 };
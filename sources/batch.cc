@@ -0,0 +1,216 @@
+//          Copyright Jean Pierre Cimalando 2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "sweepcontroller.h"
+#include "audiosys.h"
+#include "audiooptions.h"
+#include "audioprocessor.h"
+#include "analyzerdefs.h"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTimer>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cmath>
+
+// The measurement without interface: a full sweep at the levels of the
+// command line, saved as a profile, with the progress on the standard error.
+enum Exit_Status {
+    Exit_Success,
+    Exit_Invalid,
+    Exit_Latency,
+    Exit_Output,
+    Exit_Timeout,
+};
+
+static const char *const mode_names[] = {"stepped", "sweep", "mls"};
+static const char *const window_names[] = {"hann", "blackman-harris", "flat-top", "rectangular"};
+
+static int name_index(const char *const names[], unsigned count, const QString &name)
+{
+    for (unsigned i = 0; i < count; ++i) {
+        if (name == names[i])
+            return i;
+    }
+    return -1;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(app.tr(
+        "Profile the device in a full sweep, unattended.\n"
+        "Exit status: 0 if saved, 1 if the options or the audio system are invalid, "
+        "2 if the latency is not measurable, 3 if the profile is not writable, "
+        "4 if the sweep times out."));
+    parser.addHelpOption();
+    Audio_Options opt_audio;
+    opt_audio.add_to(parser);
+    QCommandLineOption opt_output({"o", "output"}, app.tr("Profile directory to write."), app.tr("dir"));
+    QCommandLineOption opt_levels("levels", app.tr("Drive levels in dB, separated by commas; or the lowest and the highest, with --level-count."), app.tr("list"));
+    QCommandLineOption opt_level_count("level-count", app.tr("Number of drive levels, evenly spaced in dB from the lowest to the highest of --levels."), app.tr("count"));
+    QCommandLineOption opt_points("points", app.tr("Number of sweep points."), app.tr("count"), QString::number(Analysis::sweep_length_default));
+    QCommandLineOption opt_parallel("parallel", app.tr("Stepped frequencies measured at once."), app.tr("count"), "1");
+    QCommandLineOption opt_mode("mode", app.tr("Measurement: stepped, sweep or mls."), app.tr("mode"), mode_names[Analysis::Mode_Stepped]);
+    QCommandLineOption opt_window("window", app.tr("Stepped window: hann, blackman-harris, flat-top or rectangular."), app.tr("window"), window_names[Analysis::Window_Hann]);
+    QCommandLineOption opt_averages("averages", app.tr("Stepped frames averaged per point."), app.tr("count"), "1");
+    QCommandLineOption opt_confidence("confidence", app.tr("Width of the confidence interval which ends the repetition of a stepped point, 0 for one measurement."), app.tr("db"), "0");
+    QCommandLineOption opt_repeats("repeats", app.tr("Most measurements of a stepped point."), app.tr("count"), QString::number(Analysis::repeats_default));
+    QCommandLineOption opt_gain("gain", app.tr("Output gain."), app.tr("db"), QString::number(20 * std::log10(Analysis::output_gain_default)));
+    QCommandLineOption opt_latency("latency", app.tr("Round-trip latency, instead of its measurement."), app.tr("samples"));
+    QCommandLineOption opt_timeout("timeout", app.tr("Longest duration of the sweep, 0 for none."), app.tr("seconds"), "0");
+    parser.addOptions({opt_output, opt_levels, opt_level_count, opt_points, opt_parallel, opt_mode, opt_window, opt_averages,
+                       opt_confidence, opt_repeats, opt_gain, opt_latency, opt_timeout});
+    parser.process(app);
+
+    auto fail = [](const QString &message) -> int {
+        std::fprintf(stderr, "%s\n", message.toLocal8Bit().data());
+        return Exit_Invalid;
+    };
+
+    const QString output = parser.value(opt_output);
+    if (output.isEmpty())
+        return fail(app.tr("No output profile"));
+
+    std::vector<double> levels;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    const QStringList level_texts = parser.value(opt_levels).split(',', Qt::SkipEmptyParts);
+#else
+    const QStringList level_texts = parser.value(opt_levels).split(',', QString::SkipEmptyParts);
+#endif
+    for (const QString &text : level_texts) {
+        bool ok = false;
+        double db = text.toDouble(&ok);
+        if (!ok || db > 0)
+            return fail(app.tr("Invalid drive level: %1").arg(text));
+        levels.push_back(db);
+    }
+
+    // the range lo,hi divided into a number of levels
+    if (parser.isSet(opt_level_count)) {
+        bool ok = false;
+        const unsigned count = parser.value(opt_level_count).toUInt(&ok);
+        if (!ok || count < 2 || count > Analysis::levels_max)
+            return fail(app.tr("Invalid number of drive levels"));
+        if (levels.size() != 2)
+            return fail(app.tr("The number of drive levels requires the lowest and the highest"));
+        const double lo = std::min(levels[0], levels[1]);
+        const double hi = std::max(levels[0], levels[1]);
+        levels.resize(count);
+        for (unsigned l = 0; l < count; ++l)
+            levels[l] = lo + (hi - lo) * l / (count - 1);
+    }
+
+    bool ok = true;
+    const unsigned points = parser.value(opt_points).toUInt(&ok);
+    if (!ok || points < Analysis::sweep_length_min || points > Analysis::sweep_length_max)
+        return fail(app.tr("Invalid number of sweep points"));
+    const unsigned parallel = parser.value(opt_parallel).toUInt(&ok);
+    if (!ok || parallel < 1 || parallel > std::min<unsigned>(Analysis::max_bins_at_once, points))
+        return fail(app.tr("Invalid number of frequencies at once"));
+    const int mode = name_index(mode_names, sizeof(mode_names) / sizeof(*mode_names), parser.value(opt_mode));
+    if (mode == -1)
+        return fail(app.tr("Invalid measurement mode"));
+    const int window = name_index(window_names, Analysis::Window_Function_Count, parser.value(opt_window));
+    if (window == -1)
+        return fail(app.tr("Invalid window function"));
+    const unsigned averages = parser.value(opt_averages).toUInt(&ok);
+    if (!ok || averages < 1 || averages > Analysis::averages_max)
+        return fail(app.tr("Invalid number of averages"));
+    const double confidence = parser.value(opt_confidence).toDouble(&ok);
+    if (!ok || confidence < 0 || confidence > Analysis::confidence_db_max)
+        return fail(app.tr("Invalid confidence interval"));
+    const unsigned repeats = parser.value(opt_repeats).toUInt(&ok);
+    if (!ok || repeats < Analysis::repeats_min || repeats > Analysis::repeats_max)
+        return fail(app.tr("Invalid number of repeats"));
+    const double gain = parser.value(opt_gain).toDouble(&ok);
+    if (!ok || gain > 0)
+        return fail(app.tr("Invalid output gain"));
+    const unsigned latency = parser.value(opt_latency).toUInt(&ok);
+    if (parser.isSet(opt_latency) && !ok)
+        return fail(app.tr("Invalid latency"));
+    const double timeout = parser.value(opt_timeout).toDouble(&ok);
+    if (!ok || timeout < 0)
+        return fail(app.tr("Invalid timeout"));
+
+    QString error;
+    if (!opt_audio.set_up(parser, app.applicationName(), error))
+        return fail(error);
+
+    Audio_Processor proc;
+    SweepController ctl(proc);
+    proc.start();
+
+    ctl.setOutputGain(std::pow(10.0, gain * 0.05));
+    if (!levels.empty())
+        ctl.setDriveLevels(levels.data(), levels.size());
+    ctl.setSweepLength(points);
+    ctl.setFreqsAtOnce(parallel);
+    ctl.setMeasurementMode(mode);
+    ctl.setWindowFunction(window);
+    ctl.setAverages(averages);
+    ctl.setConfidence(confidence);
+    ctl.setMaxRepeats(repeats);
+
+    // the progress in whole percents, at the level and the frequency of the
+    // last measurement
+    int sweep_spl = 0;
+    double sweep_freq = 0;
+    int last_percent = -1;
+    QObject::connect(&ctl, &SweepController::sweepPhaseChanged, [&](int spl) { sweep_spl = spl; });
+    QObject::connect(&ctl, &SweepController::currentFrequencyChanged, [&](double freq) { sweep_freq = freq; });
+    QObject::connect(&ctl, &SweepController::progressChanged, [&](double progress) {
+        int percent = (int)(progress * 100);
+        if (percent == last_percent)
+            return;
+        last_percent = percent;
+        std::fprintf(stderr, "%3d%% at %g dB, %.0f Hz\n", percent, ctl.driveLevel(sweep_spl), sweep_freq);
+    });
+
+    QObject::connect(&ctl, &SweepController::latencyMeasured, [&](int latency) {
+        if (latency == -1) {
+            std::fprintf(stderr, "%s\n", app.tr("Cannot measure the latency").toLocal8Bit().data());
+            app.exit(Exit_Latency);
+            return;
+        }
+        std::fprintf(stderr, "latency %d samples\n", latency);
+        ctl.setSweepActive(true);
+    });
+
+    QObject::connect(&ctl, &SweepController::sweepCompleted, [&]() {
+        if (!ctl.sweepActive())
+            return;
+        ctl.setSweepActive(false);
+        if (!ctl.saveProfile(output)) {
+            std::fprintf(stderr, "%s\n", app.tr("Could not save profile data").toLocal8Bit().data());
+            app.exit(Exit_Output);
+            return;
+        }
+        std::fprintf(stderr, "saved %s\n", output.toLocal8Bit().data());
+        app.exit(Exit_Success);
+    });
+
+    if (timeout > 0) {
+        QTimer::singleShot((int)(timeout * 1000), &app, [&]() {
+            std::fprintf(stderr, "%s\n", app.tr("The sweep timed out").toLocal8Bit().data());
+            app.exit(Exit_Timeout);
+        });
+    }
+
+    // the latency first, which aligns the captures, unless it is known
+    if (parser.isSet(opt_latency)) {
+        proc.set_latency(latency);
+        ctl.setSweepActive(true);
+    }
+    else
+        ctl.measureLatency();
+
+    int code = app.exec();
+    Audio_Sys::instance().stop();
+    return code;
+}
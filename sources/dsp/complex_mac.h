@@ -0,0 +1,37 @@
+//          Copyright Jean Pierre Cimalando 2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+#include <complex>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Complex multiply-accumulate of interleaved spectra, as of FFTW:
+// acc[i] += a[i] * b[i]. Two bins at a time with SSE, the rest in scalar.
+inline void complex_mac(std::complex<float> *acc, const std::complex<float> *a, const std::complex<float> *b, unsigned n)
+{
+    unsigned i = 0;
+#if defined(__SSE2__)
+    const __m128 sign = _mm_castsi128_ps(_mm_set_epi32(0, (int)0x80000000, 0, (int)0x80000000));
+    for (; i + 2 <= n; i += 2) {
+        __m128 va = _mm_loadu_ps((const float *)&a[i]);
+        __m128 vb = _mm_loadu_ps((const float *)&b[i]);
+        __m128 vacc = _mm_loadu_ps((const float *)&acc[i]);
+        // (ar br - ai bi, ar bi + ai br)
+        __m128 re = _mm_shuffle_ps(va, va, _MM_SHUFFLE(2, 2, 0, 0));
+        __m128 im = _mm_shuffle_ps(va, va, _MM_SHUFFLE(3, 3, 1, 1));
+        __m128 swapped = _mm_shuffle_ps(vb, vb, _MM_SHUFFLE(2, 3, 0, 1));
+        __m128 cross = _mm_xor_ps(_mm_mul_ps(im, swapped), sign);
+        vacc = _mm_add_ps(vacc, _mm_add_ps(_mm_mul_ps(re, vb), cross));
+        _mm_storeu_ps((float *)&acc[i], vacc);
+    }
+#endif
+    for (; i < n; ++i) {
+        float ar = a[i].real(), ai = a[i].imag();
+        float br = b[i].real(), bi = b[i].imag();
+        acc[i] += std::complex<float>(ar * br - ai * bi, ar * bi + ai * br);
+    }
+}
@@ -0,0 +1,70 @@
+//          Copyright Jean Pierre Cimalando 2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+#include <algorithm>
+#include <memory>
+
+// A rational filter in transposed direct form II, in double precision for
+// the orders of the fitted filters. The storage is allocated by `allocate`,
+// and the coefficients set by `set_coefficients`, outside of the real-time
+// thread.
+struct Iir_Filter
+{
+    unsigned max_order_ = 0;
+    unsigned order_ = 0;
+    std::unique_ptr<double[]> b_;
+    std::unique_ptr<double[]> a_;
+    std::unique_ptr<double[]> z_;
+
+    void allocate(unsigned max_order);
+    // a[0] is not zero, and the coefficients are normalized by it
+    void set_coefficients(const double *b, unsigned nb, const double *a, unsigned na);
+    void reset();
+    void process(const float *in, float *out, unsigned n);
+};
+
+inline void Iir_Filter::allocate(unsigned max_order)
+{
+    max_order_ = max_order;
+    order_ = 0;
+    b_.reset(new double[max_order + 1]());
+    a_.reset(new double[max_order + 1]());
+    z_.reset(new double[max_order + 1]());
+}
+
+inline void Iir_Filter::set_coefficients(const double *b, unsigned nb, const double *a, unsigned na)
+{
+    nb = std::min(nb, max_order_ + 1);
+    na = std::min(na, max_order_ + 1);
+    const unsigned order = order_ = std::max(nb, na) - 1;
+    const double a0 = a[0];
+    for (unsigned i = 0; i <= order; ++i) {
+        b_[i] = (i < nb) ? (b[i] / a0) : 0;
+        a_[i] = (i < na) ? (a[i] / a0) : 0;
+    }
+    reset();
+}
+
+inline void Iir_Filter::reset()
+{
+    std::fill_n(z_.get(), max_order_ + 1, 0.0);
+}
+
+inline void Iir_Filter::process(const float *in, float *out, unsigned n)
+{
+    const unsigned order = order_;
+    const double *b = b_.get();
+    const double *a = a_.get();
+    double *z = z_.get();
+
+    for (unsigned i = 0; i < n; ++i) {
+        const double x = in[i];
+        const double y = b[0] * x + z[0];
+        for (unsigned k = 1; k <= order; ++k)
+            z[k - 1] = b[k] * x - a[k] * y + z[k];
+        out[i] = y;
+    }
+}
@@ -0,0 +1,151 @@
+//          Copyright Jean Pierre Cimalando 2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+#include <algorithm>
+#include <memory>
+#include <cmath>
+
+// A bank of cosine oscillators computed by complex rotation.
+// The bins are processed in groups of `lanes` adjacent oscillators, laid out
+// for the compiler to vectorize. The exact phase is kept in double precision
+// and the rotators are reseeded from it every `renorm_interval` samples,
+// which bounds the drift of the recursion in both amplitude and phase.
+// The storage is allocated by `allocate`, outside of the real-time thread.
+struct Osc_Bank
+{
+    enum { lanes = 8 };
+    enum { renorm_interval = 256 };
+
+    unsigned max_ = 0;
+    unsigned capacity_ = 0;
+    unsigned count_ = 0;
+    std::unique_ptr<double[]> freq_;
+    std::unique_ptr<double[]> phase_;
+    std::unique_ptr<float[]> amp_;
+    std::unique_ptr<float[]> rot_re_;
+    std::unique_ptr<float[]> rot_im_;
+    std::unique_ptr<float[]> re_;
+    std::unique_ptr<float[]> im_;
+
+    void allocate(unsigned max);
+    void reset(unsigned count);
+    void frequency(unsigned i, double f); // f = normalized frequency
+    void phase(unsigned i, double p); // cycles
+    double phase(unsigned i) const; // cycles, in [0, 1)
+    void amplitude(unsigned i, float a);
+    void generate(float *out, unsigned n, float gain); // out = gain * sum
+
+private:
+    void seed();
+    void advance(unsigned n);
+};
+
+inline void Osc_Bank::allocate(unsigned max)
+{
+    const unsigned capacity = (max + lanes - 1) / lanes * lanes;
+    max_ = max;
+    capacity_ = capacity;
+    count_ = 0;
+    freq_.reset(new double[capacity]());
+    phase_.reset(new double[capacity]());
+    amp_.reset(new float[capacity]());
+    rot_re_.reset(new float[capacity]());
+    rot_im_.reset(new float[capacity]());
+    re_.reset(new float[capacity]());
+    im_.reset(new float[capacity]());
+}
+
+inline void Osc_Bank::reset(unsigned count)
+{
+    count_ = std::min(count, max_);
+    for (unsigned i = 0; i < capacity_; ++i) {
+        freq_[i] = 0;
+        phase_[i] = 0;
+        amp_[i] = 1;
+        rot_re_[i] = 1;
+        rot_im_[i] = 0;
+    }
+}
+
+inline void Osc_Bank::frequency(unsigned i, double f)
+{
+    freq_[i] = f;
+    rot_re_[i] = std::cos(2 * M_PI * f);
+    rot_im_[i] = std::sin(2 * M_PI * f);
+}
+
+inline void Osc_Bank::phase(unsigned i, double p)
+{
+    phase_[i] = p - std::floor(p);
+}
+
+inline double Osc_Bank::phase(unsigned i) const
+{
+    return phase_[i];
+}
+
+inline void Osc_Bank::amplitude(unsigned i, float a)
+{
+    amp_[i] = a;
+}
+
+inline void Osc_Bank::generate(float *out, unsigned n, float gain)
+{
+    std::fill_n(out, n, 0);
+
+    const unsigned groups = (count_ + lanes - 1) / lanes;
+
+    for (unsigned offset = 0; offset < n;) {
+        const unsigned len = std::min<unsigned>(n - offset, renorm_interval);
+        float *block = out + offset;
+
+        seed();
+
+        for (unsigned g = 0; g < groups; ++g) {
+            float *re = re_.get() + g * lanes;
+            float *im = im_.get() + g * lanes;
+            const float *rot_re = rot_re_.get() + g * lanes;
+            const float *rot_im = rot_im_.get() + g * lanes;
+
+            for (unsigned i = 0; i < len; ++i) {
+                float acc = 0;
+                for (unsigned l = 0; l < lanes; ++l)
+                    acc += re[l];
+                block[i] += acc;
+                for (unsigned l = 0; l < lanes; ++l) {
+                    float r = re[l] * rot_re[l] - im[l] * rot_im[l];
+                    float s = re[l] * rot_im[l] + im[l] * rot_re[l];
+                    re[l] = r;
+                    im[l] = s;
+                }
+            }
+        }
+
+        advance(len);
+        offset += len;
+    }
+
+    for (unsigned i = 0; i < n; ++i)
+        out[i] *= gain;
+}
+
+inline void Osc_Bank::seed()
+{
+    const unsigned used = (count_ + lanes - 1) / lanes * lanes;
+    for (unsigned i = 0; i < used; ++i) {
+        float amp = (i < count_) ? amp_[i] : 0;
+        re_[i] = amp * std::cos(2 * M_PI * phase_[i]);
+        im_[i] = amp * std::sin(2 * M_PI * phase_[i]);
+    }
+}
+
+inline void Osc_Bank::advance(unsigned n)
+{
+    for (unsigned i = 0; i < count_; ++i) {
+        double p = phase_[i] + n * freq_[i];
+        phase_[i] = p - std::floor(p);
+    }
+}
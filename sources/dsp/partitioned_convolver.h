@@ -0,0 +1,160 @@
+//          Copyright Jean Pierre Cimalando 2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+#include "dsp/complex_mac.h"
+#include "utility/fftw_memory.h"
+#include <algorithm>
+#include <memory>
+#include <complex>
+#include <new>
+
+// Convolution by an impulse response, uniformly partitioned in blocks of
+// `block` samples, without latency: the first partition is convolved
+// directly as the samples arrive, and the others by overlap-save in the
+// frequency domain, once per block, with the spectra of the past blocks in a
+// delay line. The output of the next block from the partitions after the
+// first only depends on the blocks which are complete, and is computed at
+// the end of each.
+// The plans, of real transforms of 2 `block` samples, are shared; the
+// storage is allocated by `allocate`, and the response set by `set_impulse`,
+// outside of the real-time thread.
+struct Partitioned_Convolver
+{
+    enum { block = 64 };
+    enum { bins = block + 1 };
+    // the spectra spaced by whole cache lines, aligned as for the plans
+    enum { stride = (bins + 7) / 8 * 8 };
+
+    fftwf_plan forward_ = nullptr;
+    fftwf_plan backward_ = nullptr;
+    unsigned max_parts_ = 0;
+    unsigned num_parts_ = 0;
+    unsigned pos_ = 0;
+    unsigned fdl_pos_ = 0;
+    float head_[block] = {};
+    std::unique_ptr<std::complex<float>[], Fftwf_Deleter> parts_;
+    std::unique_ptr<std::complex<float>[], Fftwf_Deleter> fdl_;
+    std::unique_ptr<std::complex<float>[], Fftwf_Deleter> acc_;
+    std::unique_ptr<float[], Fftwf_Deleter> time_;
+    float line_[2 * block] = {};
+    float tail_[block] = {};
+
+    void allocate(unsigned max_length, fftwf_plan forward, fftwf_plan backward);
+    void set_impulse(const float *ir, unsigned length);
+    void reset();
+    void process(const float *in, float *out, unsigned n);
+
+private:
+    void end_block();
+};
+
+inline void Partitioned_Convolver::allocate(unsigned max_length, fftwf_plan forward, fftwf_plan backward)
+{
+    typedef std::complex<float> cfloat;
+    const unsigned max_parts = std::max(1u, (max_length + block - 1) / block);
+    forward_ = forward;
+    backward_ = backward;
+    max_parts_ = max_parts;
+    num_parts_ = 0;
+    parts_.reset((cfloat *)fftwf_alloc_complex(max_parts * stride));
+    fdl_.reset((cfloat *)fftwf_alloc_complex(max_parts * stride));
+    acc_.reset((cfloat *)fftwf_alloc_complex(stride));
+    time_.reset(fftwf_alloc_real(2 * block));
+    if (!parts_ || !fdl_ || !acc_ || !time_)
+        throw std::bad_alloc();
+    reset();
+}
+
+inline void Partitioned_Convolver::set_impulse(const float *ir, unsigned length)
+{
+    typedef std::complex<float> cfloat;
+    length = std::min(length, max_parts_ * block);
+    const unsigned num_parts = num_parts_ = (length + block - 1) / block;
+
+    // the first partition reversed, for the direct form
+    for (unsigned i = 0; i < block; ++i)
+        head_[block - 1 - i] = (i < length) ? ir[i] : 0;
+
+    // the others in the frequency domain, scaled for the inverse transform
+    float *time = time_.get();
+    const float scale = 1.0f / (2 * block);
+    for (unsigned m = 1; m < num_parts; ++m) {
+        const unsigned start = m * block;
+        const unsigned count = std::min<unsigned>(block, length - start);
+        std::fill_n(time, 2 * block, 0.0f);
+        for (unsigned i = 0; i < count; ++i)
+            time[i] = ir[start + i] * scale;
+        fftwf_execute_dft_r2c(forward_, time, (fftwf_complex *)&parts_[m * stride]);
+    }
+    std::fill_n(&parts_[0], (size_t)stride, cfloat());
+
+    reset();
+}
+
+inline void Partitioned_Convolver::reset()
+{
+    pos_ = 0;
+    fdl_pos_ = 0;
+    std::fill_n(fdl_.get(), (size_t)max_parts_ * stride, std::complex<float>());
+    std::fill_n(line_, 2 * block, 0.0f);
+    std::fill_n(tail_, (unsigned)block, 0.0f);
+}
+
+inline void Partitioned_Convolver::process(const float *in, float *out, unsigned n)
+{
+    while (n > 0) {
+        const unsigned pos = pos_;
+        const unsigned len = std::min<unsigned>(n, block - pos);
+        std::copy_n(in, len, &line_[block + pos]);
+
+        // tap by tap over the samples, which vectorizes without reordering
+        // the sums
+        std::copy_n(&tail_[pos], len, out);
+        for (unsigned k = 0; k < block; ++k) {
+            const float h = head_[k];
+            const float *x = &line_[pos + k + 1];
+            for (unsigned i = 0; i < len; ++i)
+                out[i] += h * x[i];
+        }
+
+        in += len;
+        out += len;
+        n -= len;
+        if ((pos_ = pos + len) == block) {
+            end_block();
+            pos_ = 0;
+        }
+    }
+}
+
+inline void Partitioned_Convolver::end_block()
+{
+    typedef std::complex<float> cfloat;
+    const unsigned num_parts = num_parts_;
+    float *time = time_.get();
+
+    // the spectrum of the last two blocks, and the tail of the next one
+    // from it and the ones before: Y = sum over m >= 1 of H[m] X[j + 1 - m]
+    if (num_parts > 1) {
+        const unsigned ring = num_parts - 1;
+        cfloat *x = &fdl_[fdl_pos_ * stride];
+        std::copy_n(line_, 2 * block, time);
+        fftwf_execute_dft_r2c(forward_, time, (fftwf_complex *)x);
+
+        cfloat *acc = acc_.get();
+        std::fill_n(acc, (unsigned)bins, cfloat());
+        for (unsigned m = 1, slot = fdl_pos_; m < num_parts; ++m) {
+            complex_mac(acc, &parts_[m * stride], &fdl_[slot * stride], bins);
+            slot = (slot > 0) ? (slot - 1) : (ring - 1);
+        }
+        fdl_pos_ = (fdl_pos_ + 1) % ring;
+
+        fftwf_execute_dft_c2r(backward_, (fftwf_complex *)acc, time);
+        std::copy_n(&time[block], (unsigned)block, tail_);
+    }
+
+    std::copy_n(&line_[block], (unsigned)block, line_);
+}
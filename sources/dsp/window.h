@@ -0,0 +1,62 @@
+//          Copyright Jean Pierre Cimalando 2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+#include <algorithm>
+#include <cmath>
+
+// Generalized cosine windows, in the periodic (DFT-even) form which suits
+// tones placed exactly on the analysis bins.
+template <class R>
+void cosine_sum_window(R *w, unsigned n, const double *a, unsigned na)
+{
+    for (unsigned i = 0; i < n; ++i) {
+        double x = 2 * M_PI * i / n;
+        double y = 0;
+        for (unsigned k = 0; k < na; ++k)
+            y += ((k & 1) ? -a[k] : a[k]) * std::cos(k * x);
+        w[i] = y;
+    }
+}
+
+template <class R>
+void hann_window(R *w, unsigned n)
+{
+    static const double a[] = {0.5, 0.5};
+    cosine_sum_window(w, n, a, 2);
+}
+
+template <class R>
+void blackman_harris_window(R *w, unsigned n)
+{
+    static const double a[] = {0.35875, 0.48829, 0.14128, 0.01168};
+    cosine_sum_window(w, n, a, 4);
+}
+
+template <class R>
+void flat_top_window(R *w, unsigned n)
+{
+    static const double a[] = {0.21557895, 0.41663158, 0.277263158, 0.083578947, 0.006947368};
+    cosine_sum_window(w, n, a, 5);
+}
+
+// For periodic excitations whose tones all fall on bins, captured in the
+// steady state: the bins are then exactly orthogonal and do not leak.
+template <class R>
+void rectangular_window(R *w, unsigned n)
+{
+    std::fill_n(w, n, 1);
+}
+
+// The factor which converts a bin of the windowed spectrum into the
+// amplitude of a real sinusoid, ie. the inverse of half the coherent gain.
+template <class R>
+double window_amplitude_factor(const R *w, unsigned n)
+{
+    double sum = 0;
+    for (unsigned i = 0; i < n; ++i)
+        sum += w[i];
+    return 2 / sum;
+}
@@ -0,0 +1,334 @@
+//          Copyright Jean Pierre Cimalando 2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "filterfit.h"
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include <limits>
+#include <new>
+#include <cmath>
+typedef std::complex<float> cfloat;
+typedef std::complex<double> cdouble;
+
+Filter_Fitter::Filter_Fitter(unsigned fft_size)
+{
+    fft_size_ = fft_size;
+
+    spectrum_.reset(new cdouble[fft_size / 2 + 1]());
+    impulse_.reset(new float[fft_size]());
+
+    real_.reset(fftwf_alloc_real(fft_size));
+    cplx_.reset((cfloat *)fftwf_alloc_complex(fft_size / 2 + 1));
+    if (!real_ || !cplx_)
+        throw std::bad_alloc();
+
+    plan_forward_.reset(fftwf_plan_dft_r2c_1d(fft_size, real_.get(), (fftwf_complex *)cplx_.get(), FFTW_ESTIMATE));
+    plan_backward_.reset(fftwf_plan_dft_c2r_1d(fft_size, (fftwf_complex *)cplx_.get(), real_.get(), FFTW_ESTIMATE));
+    if (!plan_forward_ || !plan_backward_)
+        throw std::bad_alloc();
+}
+
+Filter_Fitter::~Filter_Fitter()
+{
+}
+
+bool Filter_Fitter::set_response(const double *freqs, const cfloat *response, unsigned count, double sample_rate)
+{
+    const unsigned N = fft_size_;
+    sample_rate_ = sample_rate;
+
+    // the measured points in dB over log-frequency, without duplicates
+    std::vector<std::pair<double, double>> points;
+    points.reserve(count);
+    for (unsigned i = 0; i < count; ++i) {
+        double mag = std::abs(response[i]);
+        if (freqs[i] > 0 && mag > 0)
+            points.emplace_back(std::log(freqs[i]), 20 * std::log10(mag));
+    }
+    std::stable_sort(
+        points.begin(), points.end(),
+        [](const std::pair<double, double> &p, const std::pair<double, double> &q) { return p.first < q.first; });
+    points.erase(
+        std::unique(points.begin(), points.end(),
+                    [](const std::pair<double, double> &p, const std::pair<double, double> &q) { return p.first == q.first; }),
+        points.end());
+
+    const unsigned n = points.size();
+    if (n < 2)
+        return false;
+
+    // the second derivatives of the natural spline, by the tridiagonal
+    // system of its continuity
+    std::vector<double> d2(n), diag(n), rhs(n);
+    for (unsigned i = 1; i + 1 < n; ++i) {
+        double h0 = points[i].first - points[i - 1].first;
+        double h1 = points[i + 1].first - points[i].first;
+        double s0 = (points[i].second - points[i - 1].second) / h0;
+        double s1 = (points[i + 1].second - points[i].second) / h1;
+        diag[i] = 2 * (h0 + h1);
+        rhs[i] = 6 * (s1 - s0);
+        if (i > 1) {
+            double m = h0 / diag[i - 1];
+            diag[i] -= m * h0;
+            rhs[i] -= m * rhs[i - 1];
+        }
+    }
+    for (unsigned i = n - 1; i-- > 1;) {
+        double h1 = points[i + 1].first - points[i].first;
+        d2[i] = (rhs[i] - h1 * d2[i + 1]) / diag[i];
+    }
+
+    auto spline = [&](double x) -> double {
+        if (x <= points.front().first)
+            return points.front().second;
+        if (x >= points.back().first)
+            return points.back().second;
+        unsigned i = std::upper_bound(
+            points.begin(), points.end(), x,
+            [](double x, const std::pair<double, double> &p) { return x < p.first; }) - points.begin() - 1;
+        double h = points[i + 1].first - points[i].first;
+        double t1 = (points[i + 1].first - x) / h;
+        double t0 = (x - points[i].first) / h;
+        return t1 * points[i].second + t0 * points[i + 1].second +
+            ((t1 * t1 * t1 - t1) * d2[i] + (t0 * t0 * t0 - t0) * d2[i + 1]) * (h * h) / 6;
+    };
+
+    // the log-magnitude on the bins, the DC held at the lowest point
+    cfloat *cplx = cplx_.get();
+    float *real = real_.get();
+    for (unsigned k = 0; k <= N / 2; ++k) {
+        double db = (k == 0) ? points.front().second : spline(std::log(k * sample_rate / N));
+        cplx[k] = (float)(db * (M_LN10 / 20));
+    }
+
+    // the real cepstrum, folded onto positive quefrencies, gives the
+    // logarithm of the minimum-phase spectrum
+    fftwf_execute(plan_backward_.get());
+    const float scale = 1.0f / N;
+    real[0] *= scale;
+    for (unsigned i = 1; i < N / 2; ++i)
+        real[i] *= 2 * scale;
+    real[N / 2] *= scale;
+    std::fill(real + N / 2 + 1, real + N, 0.0f);
+    fftwf_execute(plan_forward_.get());
+
+    for (unsigned k = 0; k <= N / 2; ++k) {
+        spectrum_[k] = std::exp(cdouble(cplx[k]));
+        cplx[k] = cfloat(spectrum_[k]);
+    }
+
+    fftwf_execute(plan_backward_.get());
+    for (unsigned i = 0; i < N; ++i)
+        impulse_[i] = real[i] * scale;
+
+    return true;
+}
+
+// reflect the roots of the denominator which are outside the unit circle,
+// leaving the magnitude the same up to a gain; false if all are inside
+static bool stabilize(double *a, unsigned np)
+{
+    if (np == 0)
+        return false;
+
+    // the roots of z^np + a1 z^(np-1) + ... + anp, by Durand-Kerner
+    auto eval = [a, np](cdouble z) -> cdouble {
+        cdouble p = 1;
+        for (unsigned j = 1; j <= np; ++j)
+            p = p * z + a[j];
+        return p;
+    };
+    std::vector<cdouble> roots(np);
+    for (unsigned i = 0; i < np; ++i)
+        roots[i] = std::pow(cdouble(0.4, 0.9), (double)i);
+    for (unsigned iter = 0; iter < 500; ++iter) {
+        double change = 0;
+        for (unsigned i = 0; i < np; ++i) {
+            cdouble den = 1;
+            for (unsigned j = 0; j < np; ++j) {
+                if (j != i)
+                    den *= roots[i] - roots[j];
+            }
+            cdouble delta = eval(roots[i]) / den;
+            roots[i] -= delta;
+            change = std::max(change, std::abs(delta));
+        }
+        if (change < 1e-14)
+            break;
+    }
+
+    bool reflected = false;
+    for (cdouble &root : roots) {
+        if (std::abs(root) > 1) {
+            root = 1.0 / std::conj(root);
+            reflected = true;
+        }
+    }
+    if (!reflected)
+        return false;
+
+    std::vector<cdouble> poly(np + 1);
+    poly[0] = 1;
+    for (unsigned i = 0; i < np; ++i) {
+        for (unsigned j = i + 1; j > 0; --j)
+            poly[j] -= roots[i] * poly[j - 1];
+    }
+    for (unsigned j = 1; j <= np; ++j)
+        a[j] = poly[j].real();
+    return true;
+}
+
+bool Filter_Fitter::solve(unsigned nz, unsigned np, const double *weight, const double *a_fixed, double *b, double *a) const
+{
+    const unsigned N = fft_size_;
+    const unsigned ns = N / 2 + 1;
+    const cdouble *target = spectrum_.get();
+
+    // the least squares of B(z) - D(z) (A(z) - 1) = D(z) over the bins, in
+    // real and imaginary parts, or of B(z) = D(z) A(z) with A given
+    const unsigned cols = nz + 1 + (a_fixed ? 0 : np);
+    const unsigned rows = 2 * ns;
+    std::vector<double> m(rows * cols), y(rows);
+    for (unsigned k = 0; k < ns; ++k) {
+        const double sw = std::sqrt(weight[k]);
+        const double w = M_PI * k / (N / 2);
+        cdouble rhs = target[k];
+        if (a_fixed) {
+            cdouble den = 0;
+            for (unsigned j = 0; j <= np; ++j)
+                den += a_fixed[j] * std::polar(1.0, -w * j);
+            rhs *= den;
+        }
+        double *re = &m[(2 * k) * cols];
+        double *im = &m[(2 * k + 1) * cols];
+        for (unsigned i = 0; i <= nz; ++i) {
+            cdouble z = std::polar(sw, -w * i);
+            re[i] = z.real();
+            im[i] = z.imag();
+        }
+        for (unsigned j = 1; !a_fixed && j <= np; ++j) {
+            cdouble z = -target[k] * std::polar(sw, -w * j);
+            re[nz + j] = z.real();
+            im[nz + j] = z.imag();
+        }
+        y[2 * k] = sw * rhs.real();
+        y[2 * k + 1] = sw * rhs.imag();
+    }
+
+    // by Householder QR, better conditioned than the normal equations
+    double norm_max = 0;
+    for (unsigned j = 0; j < cols; ++j) {
+        double norm = 0;
+        for (unsigned r = j; r < rows; ++r)
+            norm += m[r * cols + j] * m[r * cols + j];
+        norm = std::sqrt(norm);
+        norm_max = std::max(norm_max, norm);
+        if (norm <= 1e-12 * norm_max)
+            return false;
+
+        double alpha = (m[j * cols + j] > 0) ? -norm : norm;
+        double v0 = m[j * cols + j] - alpha;
+        m[j * cols + j] = v0;
+        double vnorm2 = v0 * v0;
+        for (unsigned r = j + 1; r < rows; ++r)
+            vnorm2 += m[r * cols + j] * m[r * cols + j];
+
+        for (unsigned c = j + 1; c < cols; ++c) {
+            double dot = 0;
+            for (unsigned r = j; r < rows; ++r)
+                dot += m[r * cols + j] * m[r * cols + c];
+            double f = 2 * dot / vnorm2;
+            for (unsigned r = j; r < rows; ++r)
+                m[r * cols + c] -= f * m[r * cols + j];
+        }
+        double dot = 0;
+        for (unsigned r = j; r < rows; ++r)
+            dot += m[r * cols + j] * y[r];
+        double f = 2 * dot / vnorm2;
+        for (unsigned r = j; r < rows; ++r)
+            y[r] -= f * m[r * cols + j];
+
+        m[j * cols + j] = alpha;
+    }
+
+    std::vector<double> x(cols);
+    for (unsigned j = cols; j-- > 0;) {
+        double sum = y[j];
+        for (unsigned c = j + 1; c < cols; ++c)
+            sum -= m[j * cols + c] * x[c];
+        x[j] = sum / m[j * cols + j];
+    }
+
+    std::copy(x.data(), x.data() + nz + 1, b);
+    if (!a_fixed) {
+        a[0] = 1;
+        std::copy(x.data() + nz + 1, x.data() + cols, a + 1);
+    }
+    return true;
+}
+
+double Filter_Fitter::fit_iir(unsigned nz, unsigned np, double *b, double *a, unsigned iterations) const
+{
+    const unsigned N = fft_size_;
+    const unsigned ns = N / 2 + 1;
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+
+    std::vector<double> weight(ns), reweight(ns);
+    for (unsigned k = 0; k < ns; ++k)
+        weight[k] = 1 / (k * sample_rate_ / N + 1);
+
+    // the numerator again for the denominator made stable, and the error
+    auto finish = [&](double *b, double *a) -> double {
+        if (stabilize(a, np) && !solve(nz, np, weight.data(), a, b, a))
+            return nan;
+        double sum = 0;
+        for (unsigned k = 0; k < ns; ++k) {
+            cdouble h = response(b, nz + 1, a, np + 1, k * sample_rate_ / N, sample_rate_);
+            double err = 20 * std::log10(std::abs(h) / std::abs(spectrum_[k]));
+            sum += err * err;
+        }
+        return std::sqrt(sum / ns);
+    };
+
+    if (!solve(nz, np, weight.data(), nullptr, b, a))
+        return nan;
+    double error = finish(b, a);
+
+    // each iteration weights the equation error by the last denominator,
+    // which approaches the error of the output; it does not always descend
+    // it when the order is short, so the best fit is kept
+    std::vector<double> b_iter(b, b + nz + 1), a_iter(a, a + np + 1);
+    for (unsigned iter = 0; iter < iterations && !std::isnan(error); ++iter) {
+        for (unsigned k = 0; k < ns; ++k) {
+            cdouble den = response(a_iter.data(), np + 1, nullptr, 0, k * sample_rate_ / N, sample_rate_);
+            reweight[k] = weight[k] / std::norm(den);
+        }
+        if (!solve(nz, np, reweight.data(), nullptr, b_iter.data(), a_iter.data()))
+            break;
+        double iter_error = finish(b_iter.data(), a_iter.data());
+        if (std::isnan(iter_error))
+            break;
+        if (iter_error < error) {
+            error = iter_error;
+            std::copy(b_iter.begin(), b_iter.end(), b);
+            std::copy(a_iter.begin(), a_iter.end(), a);
+        }
+    }
+
+    return error;
+}
+
+cdouble Filter_Fitter::response(const double *b, unsigned nb, const double *a, unsigned na, double f, double sample_rate)
+{
+    const double w = 2 * M_PI * f / sample_rate;
+    cdouble num = 0;
+    for (unsigned i = 0; i < nb; ++i)
+        num += b[i] * std::polar(1.0, -w * i);
+    cdouble den = (na > 0) ? 0 : 1;
+    for (unsigned j = 0; j < na; ++j)
+        den += a[j] * std::polar(1.0, -w * j);
+    return num / den;
+}
@@ -0,0 +1,57 @@
+//          Copyright Jean Pierre Cimalando 2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+#include "utility/fftw_memory.h"
+#include <memory>
+#include <complex>
+
+// Filter fitted to a measured magnitude response, after the method of
+// docs/FiltreBoiteNoire.m: the magnitude is interpolated onto the bins of an
+// FFT, made minimum-phase by folding its real cepstrum (Oppenheim & Schafer),
+// and approximated by a rational transfer function by the equation error of
+// invfreqz, weighted by 1/(f+1), which the iterations of Steiglitz-McBride
+// (1965) refine towards the output error.
+class Filter_Fitter {
+public:
+    explicit Filter_Fitter(unsigned fft_size = 1024);
+    ~Filter_Fitter();
+
+    unsigned fft_size() const { return fft_size_; }
+    double sample_rate() const { return sample_rate_; }
+
+    // the target, of the magnitudes of a response at frequencies in Hz, the
+    // unmeasured points zero: a cubic spline in dB over log-frequency puts
+    // them on the bins, held at the ends beyond the measured range; false if
+    // fewer than two points are measured
+    bool set_response(const double *freqs, const std::complex<float> *response, unsigned count, double sample_rate);
+
+    // the minimum-phase target on the bins from 0 to N/2, and its impulse
+    // response of N samples
+    const std::complex<double> *spectrum() const { return spectrum_.get(); }
+    const float *impulse_response() const { return impulse_.get(); }
+
+    // fit the numerator of nz+1 coefficients and the denominator of np+1,
+    // the first 1, to the target, its poles reflected inside the unit circle
+    // if any are outside; return the RMS of the error in dB over the bins,
+    // NaN if the system is singular
+    double fit_iir(unsigned nz, unsigned np, double *b, double *a, unsigned iterations = 0) const;
+
+    // the response of a rational transfer function at a frequency in Hz
+    static std::complex<double> response(const double *b, unsigned nb, const double *a, unsigned na, double f, double sample_rate);
+
+private:
+    bool solve(unsigned nz, unsigned np, const double *weight, const double *a_fixed, double *b, double *a) const;
+
+private:
+    unsigned fft_size_ = 0;
+    double sample_rate_ = 0;
+    std::unique_ptr<std::complex<double>[]> spectrum_;
+    std::unique_ptr<float[]> impulse_;
+    std::unique_ptr<float[], Fftwf_Deleter> real_;
+    std::unique_ptr<std::complex<float>[], Fftwf_Deleter> cplx_;
+    std::unique_ptr<fftwf_plan_s, Fftwf_Plan_Deleter> plan_forward_;
+    std::unique_ptr<fftwf_plan_s, Fftwf_Plan_Deleter> plan_backward_;
+};
@@ -0,0 +1,101 @@
+//          Copyright Jean Pierre Cimalando 2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "jackbackend.h"
+#include <QCoreApplication>
+
+Jack_Backend::Jack_Backend(const char *client_name, unsigned channels)
+{
+    QCoreApplication *app = QCoreApplication::instance();
+
+    jack_client_t *client = jack_client_open(client_name, JackNoStartServer, nullptr);
+    if (!client)
+        return;
+
+    client_.reset(client);
+
+    in_.reset(new jack_port_t *[channels]);
+    out_.reset(new jack_port_t *[channels]);
+    in_buf_.reset(new const float *[channels]);
+    out_buf_.reset(new float *[channels]);
+
+    // a pair of ports by channel, numbered if there are several
+    for (unsigned c = 0; c < channels; ++c) {
+        QString in_name = app->tr("Measurement input");
+        QString out_name = app->tr("Generator output");
+        if (channels > 1) {
+            in_name += QString(" %1").arg(c + 1);
+            out_name += QString(" %1").arg(c + 1);
+        }
+        jack_port_t *in = jack_port_register(client, in_name.toUtf8().data(), JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0);
+        jack_port_t *out = jack_port_register(client, out_name.toUtf8().data(), JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
+        if (!in || !out) {
+            client_.reset();
+            return;
+        }
+        in_[c] = in;
+        out_[c] = out;
+    }
+
+    channels_ = channels;
+
+    jack_set_process_callback(client, &process, this);
+}
+
+Jack_Backend::~Jack_Backend()
+{
+}
+
+Jack_Backend::operator bool() const
+{
+    return client_ != nullptr;
+}
+
+float Jack_Backend::sample_rate() const
+{
+    return jack_get_sample_rate(client_.get());
+}
+
+unsigned Jack_Backend::buffer_size() const
+{
+    return jack_get_buffer_size(client_.get());
+}
+
+unsigned Jack_Backend::num_channels() const
+{
+    return channels_;
+}
+
+void Jack_Backend::start(Process_Fn *fn, void *data)
+{
+    jack_client_t *client = client_.get();
+    jack_deactivate(client);
+    cb_fn_ = fn;
+    cb_data_ = data;
+    jack_activate(client);
+}
+
+void Jack_Backend::stop()
+{
+    jack_client_t *client = client_.get();
+    jack_deactivate(client);
+}
+
+int Jack_Backend::process(jack_nframes_t nframes, void *userdata)
+{
+    Jack_Backend *self = (Jack_Backend *)userdata;
+
+    const float **in = self->in_buf_.get();
+    float **out = self->out_buf_.get();
+    for (unsigned c = 0, channels = self->channels_; c < channels; ++c) {
+        in[c] = (float *)jack_port_get_buffer(self->in_[c], nframes);
+        out[c] = (float *)jack_port_get_buffer(self->out_[c], nframes);
+    }
+
+    if (self->cb_fn_)
+        self->cb_fn_(in, out, nframes, self->cb_data_);
+
+    return 0;
+}
@@ -0,0 +1,39 @@
+//          Copyright Jean Pierre Cimalando 2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+#include "audiobackend.h"
+#include <jack/jack.h>
+#include <memory>
+
+class Jack_Backend : public Audio_Backend {
+public:
+    explicit Jack_Backend(const char *client_name, unsigned channels = 1);
+    ~Jack_Backend();
+    explicit operator bool() const;
+
+    float sample_rate() const override;
+    unsigned buffer_size() const override;
+    unsigned num_channels() const override;
+
+    void start(Process_Fn *fn, void *data) override;
+    void stop() override;
+
+private:
+    struct Jack_Deleter {
+        void operator()(jack_client_t *x) { jack_client_close(x); }
+    };
+
+    std::unique_ptr<jack_client_t, Jack_Deleter> client_;
+    unsigned channels_ = 0;
+    std::unique_ptr<jack_port_t *[]> in_;
+    std::unique_ptr<jack_port_t *[]> out_;
+    std::unique_ptr<const float *[]> in_buf_;
+    std::unique_ptr<float *[]> out_buf_;
+    Process_Fn *cb_fn_ = nullptr;
+    void *cb_data_ = nullptr;
+
+    static int process(jack_nframes_t nframes, void *userdata);
+};
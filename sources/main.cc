@@ -6,22 +6,27 @@
 #include "application.h"
 #include "mainwindow.h"
 #include "audiosys.h"
+#include "audiooptions.h"
 #include "audioprocessor.h"
-#include "analyzerdefs.h"
+#include <QCommandLineParser>
 #include <QMessageBox>
 
 int main(int argc, char *argv[])
 {
     Application app(argc, argv);
 
-    Audio_Sys &sys = Audio_Sys::instance();
-    if (!sys) {
-        QMessageBox::warning(nullptr, app.tr("Error"), app.tr("Cannot start the JACK audio system"));
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    Audio_Options opt_audio;
+    opt_audio.add_to(parser);
+    parser.process(app);
+
+    QString error;
+    if (!opt_audio.set_up(parser, app.applicationName(), error)) {
+        QMessageBox::warning(nullptr, app.tr("Error"), error);
         return 1;
     }
 
-    Analysis::sample_rate = sys.sample_rate();
-
     Audio_Processor proc;
     app.setAudioProcessor(proc);
     proc.start();
@@ -31,6 +36,6 @@ int main(int argc, char *argv[])
     window.show();
 
     int code = app.exec();
-    sys.stop();
+    Audio_Sys::instance().stop();
     return code;
 }
@@ -14,18 +14,30 @@
 #include <qwt_plot_legenditem.h>
 #include <qwt_plot_picker.h>
 #include <qwt_symbol.h>
+#include <QStringList>
+#include <QSignalBlocker>
+#include <QVector>
+#include <QPointF>
+#include <algorithm>
+#include <vector>
 #include <cmath>
 
 struct MainWindow::Impl {
     Ui::MainWindow ui;
-    QwtPlotCurve *curve_lo_mag_ = nullptr;
-    QwtPlotCurve *curve_lo_phase_ = nullptr;
-    QwtPlotCurve *curve_hi_mag_ = nullptr;
-    QwtPlotCurve *curve_hi_phase_ = nullptr;
+    std::vector<QwtPlotCurve *> curve_mag_;
+    std::vector<QwtPlotCurve *> curve_phase_;
+    std::vector<QwtPlotCurve *> curve_thd_;
+    std::vector<QwtPlotCurve *> curve_thdn_;
+    std::vector<QwtPlotCurve *> curve_noisy_;
+    std::vector<QwtPlotCurve *> curve_filter_;
+    std::vector<QwtPlotCurve *> curve_diff_mag_;
+    std::vector<QwtPlotCurve *> curve_diff_phase_;
+    std::vector<QwtPlotCurve *> curve_ref_;
     QwtPlotMarker *marker_mag_ = nullptr;
     QwtPlotMarker *marker_phase_ = nullptr;
     QwtPlotLegendItem *legend_mag_ = nullptr;
     QwtPlotLegendItem *legend_phase_ = nullptr;
+    void setup_level_curves();
 };
 
 MainWindow::MainWindow(QWidget *parent)
@@ -42,18 +54,6 @@ MainWindow::MainWindow(QWidget *parent)
         grid->attach(plt);
     }
 
-    QColor color_lo(Qt::green);
-    QColor color_hi(Qt::red);
-
-    QwtPlotCurve *curve_lo_mag = P->curve_lo_mag_ = new QwtPlotCurve(tr("Lo Signal Gain"));
-    curve_lo_mag->attach(P->ui.pltAmplitude);
-    curve_lo_mag->setPen(color_lo, 0.0, Qt::SolidLine);
-    QwtPlotCurve *curve_lo_phase = P->curve_lo_phase_ = new QwtPlotCurve(tr("Lo Signal Phase"));
-    curve_lo_phase->setStyle(QwtPlotCurve::NoCurve);
-    QwtSymbol *sym_lo_phase = new QwtSymbol(QwtSymbol::Ellipse, QBrush(Qt::transparent), QPen(color_lo), QSize(6, 6));
-    curve_lo_phase->setSymbol(sym_lo_phase);
-    curve_lo_phase->attach(P->ui.pltPhase);
-
     ///
     class AmpPicker : public QwtPlotPicker {
     public:
@@ -95,15 +95,6 @@ MainWindow::MainWindow(QWidget *parent)
     Q_UNUSED(phase_picker);
     ///
 
-    QwtPlotCurve *curve_hi_mag = P->curve_hi_mag_ = new QwtPlotCurve(tr("Hi Signal Gain"));
-    curve_hi_mag->attach(P->ui.pltAmplitude);
-    curve_hi_mag->setPen(color_hi, 0.0, Qt::SolidLine);
-    QwtPlotCurve *curve_hi_phase = P->curve_hi_phase_ = new QwtPlotCurve(tr("Hi Signal Phase"));
-    curve_hi_phase->setStyle(QwtPlotCurve::NoCurve);
-    QwtSymbol *sym_hi_phase = new QwtSymbol(QwtSymbol::Triangle, QBrush(Qt::transparent), QPen(color_hi), QSize(6, 6));
-    curve_hi_phase->setSymbol(sym_hi_phase);
-    curve_hi_phase->attach(P->ui.pltPhase);
-
     QwtPlotMarker *marker_mag = P->marker_mag_ = new QwtPlotMarker;
     marker_mag->attach(P->ui.pltAmplitude);
     marker_mag->setLineStyle(QwtPlotMarker::VLine);
@@ -136,51 +127,163 @@ MainWindow::MainWindow(QWidget *parent)
     }
 
     P->ui.pltAmplitude->setAxisScale(QwtPlot::yLeft, Analysis::db_range_min, Analysis::db_range_max);
+    // the distortion on the right, relative to the fundamental
+    P->ui.pltAmplitude->enableAxis(QwtPlot::yRight);
+    P->ui.pltAmplitude->setAxisScale(QwtPlot::yRight, Analysis::distortion_db_min, 0);
+    P->ui.pltAmplitude->setAxisTitle(QwtPlot::yRight, tr("Distortion (dB)"));
     P->ui.pltPhase->setAxisScale(QwtPlot::yLeft, -M_PI, +M_PI);
 
-    P->ui.sl_gain->setValue(20 * std::log10(Analysis::global_gain));
+    P->ui.sl_gain->setValue(20 * std::log10(theApplication->outputGain()));
 
     connect(P->ui.btn_startSweep, &QAbstractButton::clicked, theApplication, &Application::setSweepActive);
     connect(P->ui.btn_save, &QAbstractButton::clicked, theApplication, &Application::saveProfile);
+    connect(P->ui.btn_calibrate, &QAbstractButton::clicked, theApplication, &Application::measureLatency);
+    connect(P->ui.btn_loadReference, &QAbstractButton::clicked, theApplication, &Application::loadReferences);
+    connect(P->ui.btn_clearReferences, &QAbstractButton::clicked, theApplication, &Application::clearReferences);
+    connect(P->ui.btn_fitFilter, &QAbstractButton::clicked, theApplication, &Application::fitFilters);
+    connect(
+        P->ui.btn_startSweep, &QAbstractButton::toggled,
+        P->ui.btn_calibrate, &QWidget::setDisabled);
 
     connect(
         P->ui.sl_gain, &QwtSlider::valueChanged,
-        this, [](double v) { Analysis::global_gain = std::pow(10.0, v * 0.05); });
+        this, [](double v) { theApplication->setOutputGain(std::pow(10.0, v * 0.05)); });
 
-    P->ui.btn_lo->setChecked(true);
-    P->ui.btn_hi->setChecked(true);
+    showDriveLevels();
+    connect(
+        P->ui.le_levels, &QLineEdit::editingFinished,
+        this, [this]() {
+                  std::vector<double> levels;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+                  const QStringList texts = P->ui.le_levels->text().split(' ', Qt::SkipEmptyParts);
+#else
+                  const QStringList texts = P->ui.le_levels->text().split(' ', QString::SkipEmptyParts);
+#endif
+                  for (const QString &text : texts) {
+                      bool ok = false;
+                      double db = text.toDouble(&ok);
+                      if (ok && db <= 0)
+                          levels.push_back(db);
+                  }
+                  if (!levels.empty())
+                      theApplication->setDriveLevels(levels.data(), levels.size());
+                  else
+                      showDriveLevels();
+              });
+    connect(
+        P->ui.btn_startSweep, &QAbstractButton::toggled,
+        P->ui.le_levels, &QWidget::setDisabled);
 
+    P->ui.sp_points->setRange(Analysis::sweep_length_min, Analysis::sweep_length_max);
+    P->ui.sp_points->setValue(theApplication->sweepLength());
     connect(
-        P->ui.btn_lo, &QCheckBox::clicked,
-        this, [this](bool checked) {
-            theApplication->setSweepEnabled(checked, P->ui.btn_hi->isChecked());
-            P->curve_lo_mag_->setVisible(checked);
-            P->curve_lo_phase_->setVisible(checked);
-        });
+        P->ui.sp_points, QOverload<int>::of(&QSpinBox::valueChanged),
+        this, [this](int num) {
+                  theApplication->setSweepLength(num);
+                  P->ui.sp_parallel->setMaximum(std::min<unsigned>(Analysis::max_bins_at_once, num));
+              });
     connect(
-        P->ui.btn_hi, &QCheckBox::clicked,
-        this, [this](bool checked) {
-            theApplication->setSweepEnabled(P->ui.btn_lo->isChecked(), checked);
-            P->curve_hi_mag_->setVisible(checked);
-            P->curve_hi_phase_->setVisible(checked);
-        });
+        P->ui.btn_startSweep, &QAbstractButton::toggled,
+        P->ui.sp_points, &QWidget::setDisabled);
 
-    P->ui.sp_parallel->setRange(1, Analysis::max_bins_at_once);
+    P->ui.sp_margin->setRange(Analysis::settle_margin_min, Analysis::settle_margin_max);
+    P->ui.sp_margin->setValue(Analysis::settle_margin_default);
+    connect(
+        P->ui.sp_margin, QOverload<int>::of(&QSpinBox::valueChanged),
+        this, [](int margin) { theApplication->setSettleMargin(margin); });
+    connect(
+        P->ui.chk_crossfade, &QCheckBox::toggled,
+        this, [](bool checked) { theApplication->setCrossfade(checked); });
+
+    for (unsigned c = 0, channels = theApplication->numChannels(); c < channels; ++c)
+        P->ui.cb_channel->addItem(tr("Channel %1").arg(c + 1));
+    P->ui.cb_channel->setEnabled(theApplication->numChannels() > 1);
+    connect(
+        P->ui.cb_channel, QOverload<int>::of(&QComboBox::currentIndexChanged),
+        this, [](int index) { theApplication->setPlotChannel(index); });
+
+    P->ui.sp_parallel->setRange(1, std::min<unsigned>(Analysis::max_bins_at_once, theApplication->sweepLength()));
     connect(
         P->ui.sp_parallel, QOverload<int>::of(&QSpinBox::valueChanged),
         this, [](int num) { theApplication->setFreqsAtOnce(num); });
 
+    P->ui.cb_window->addItem(tr("Hann"), Analysis::Window_Hann);
+    P->ui.cb_window->addItem(tr("Blackman-Harris"), Analysis::Window_Blackman_Harris);
+    P->ui.cb_window->addItem(tr("Flat-top"), Analysis::Window_Flat_Top);
+    P->ui.cb_window->addItem(tr("Rectangular"), Analysis::Window_Rectangular);
     connect(
-        theApplication, &Application::sweepPhaseChanged,
-        this, [this](int spl) {
-                  const char *text;
-                  switch (spl) {
-                  case Analysis::Signal_Lo: text = "Lo"; break;
-                  case Analysis::Signal_Hi: text = "Hi"; break;
-                  default: text = "None"; break;
-                  }
-                  P->ui.lbl_sweep->setText(text);
+        P->ui.cb_window, QOverload<int>::of(&QComboBox::currentIndexChanged),
+        this, [this](int index) { theApplication->setWindowFunction(P->ui.cb_window->itemData(index).toInt()); });
+
+    P->ui.sp_averages->setRange(1, Analysis::averages_max);
+    connect(
+        P->ui.sp_averages, QOverload<int>::of(&QSpinBox::valueChanged),
+        this, [](int num) { theApplication->setAverages(num); });
+
+    P->ui.sp_confidence->setRange(0, Analysis::confidence_db_max);
+    P->ui.sp_repeats->setRange(Analysis::repeats_min, Analysis::repeats_max);
+    P->ui.sp_repeats->setValue(Analysis::repeats_default);
+    connect(
+        P->ui.sp_confidence, QOverload<double>::of(&QDoubleSpinBox::valueChanged),
+        this, [](double width) { theApplication->setConfidence(width); });
+    connect(
+        P->ui.sp_repeats, QOverload<int>::of(&QSpinBox::valueChanged),
+        this, [](int num) { theApplication->setMaxRepeats(num); });
+
+    for (QSpinBox *sp : {P->ui.sp_filterZeros, P->ui.sp_filterPoles}) {
+        sp->setRange(0, Analysis::filter_order_max);
+        sp->setValue(Analysis::filter_order_default);
+        connect(
+            sp, QOverload<int>::of(&QSpinBox::valueChanged),
+            this, [this]() { theApplication->setFilterOrder(P->ui.sp_filterZeros->value(), P->ui.sp_filterPoles->value()); });
+    }
+    P->ui.sp_filterIterations->setRange(0, Analysis::filter_iterations_max);
+    P->ui.sp_filterIterations->setValue(Analysis::filter_iterations_default);
+    connect(
+        P->ui.sp_filterIterations, QOverload<int>::of(&QSpinBox::valueChanged),
+        this, [](int num) { theApplication->setFilterIterations(num); });
+
+    P->ui.cb_emulation->addItem(tr("Device"), Analysis::Emulation_Live);
+    P->ui.cb_emulation->addItem(tr("Model FIR"), Analysis::Emulation_Fir);
+    P->ui.cb_emulation->addItem(tr("Model IIR"), Analysis::Emulation_Iir);
+    auto set_emulation = [this]() {
+        int mode = P->ui.cb_emulation->currentData().toInt();
+        int level = std::max(0, P->ui.cb_emulationLevel->currentIndex());
+        if (!theApplication->setEmulation(mode, level))
+            P->ui.cb_emulation->setCurrentIndex(0);
+    };
+    connect(
+        P->ui.cb_emulation, QOverload<int>::of(&QComboBox::currentIndexChanged),
+        this, set_emulation);
+    connect(
+        P->ui.cb_emulationLevel, QOverload<int>::of(&QComboBox::currentIndexChanged),
+        this, [this, set_emulation]() {
+                  if (P->ui.cb_emulation->currentData().toInt() != Analysis::Emulation_Live)
+                      set_emulation();
               });
+
+    P->ui.cb_mode->addItem(tr("Stepped sine"), Analysis::Mode_Stepped);
+    P->ui.cb_mode->addItem(tr("Sine sweep"), Analysis::Mode_Sweep);
+    P->ui.cb_mode->addItem(tr("MLS noise"), Analysis::Mode_Mls);
+    connect(
+        P->ui.cb_mode, QOverload<int>::of(&QComboBox::currentIndexChanged),
+        this, [this](int index) {
+                  int mode = P->ui.cb_mode->itemData(index).toInt();
+                  theApplication->setMeasurementMode(mode);
+                  P->ui.sp_parallel->setEnabled(mode == Analysis::Mode_Stepped);
+                  P->ui.cb_window->setEnabled(mode == Analysis::Mode_Stepped);
+                  P->ui.sp_averages->setEnabled(mode == Analysis::Mode_Stepped);
+                  P->ui.w_confidence->setEnabled(mode == Analysis::Mode_Stepped);
+              });
+
+    auto show_sweep_phase = [this](int spl) {
+        QString text = tr("None");
+        if (spl >= 0 && (unsigned)spl < theApplication->numLevels())
+            text = QString::number(theApplication->driveLevel(spl)) + " dB";
+        P->ui.lbl_sweep->setText(text);
+    };
+    show_sweep_phase(0);
+    connect(theApplication, &Application::sweepPhaseChanged, this, show_sweep_phase);
 }
 
 MainWindow::~MainWindow()
@@ -212,15 +315,53 @@ void MainWindow::showProgress(float progress)
     P->ui.progressBar->setValue(std::lround(progress * 100));
 }
 
+void MainWindow::showLatency(int latency)
+{
+    QString text;
+    if (latency < 0)
+        text = tr("No signal");
+    else
+        text = QString::number(latency * 1e3 / Analysis::sample_rate, 'f', 1) + " ms";
+    P->ui.lbl_latency->setText(text);
+}
+
+void MainWindow::showDriveLevels()
+{
+    QStringList texts;
+    for (unsigned l = 0, n = theApplication->numLevels(); l < n; ++l)
+        texts.append(QString::number(theApplication->driveLevel(l)));
+    P->ui.le_levels->setText(texts.join(' '));
+
+    {
+        QSignalBlocker blocker(P->ui.cb_emulationLevel);
+        P->ui.cb_emulationLevel->clear();
+        for (const QString &text : texts)
+            P->ui.cb_emulationLevel->addItem(text + " dB");
+    }
+
+    P->setup_level_curves();
+}
+
 void MainWindow::showPlotData(
     const double *freqs, double freqmark,
-    const double *lo_mags, const double *lo_phases,
-    const double *hi_mags, const double *hi_phases, unsigned n)
+    const double *mags, const double *phases,
+    const double *thd, const double *thdn,
+    const float *coherence, unsigned num_levels, unsigned n)
 {
-    P->curve_lo_mag_->setRawSamples(freqs, lo_mags, n);
-    P->curve_lo_phase_->setRawSamples(freqs, lo_phases, n);
-    P->curve_hi_mag_->setRawSamples(freqs, hi_mags, n);
-    P->curve_hi_phase_->setRawSamples(freqs, hi_phases, n);
+    num_levels = std::min<unsigned>(num_levels, P->curve_mag_.size());
+    for (unsigned l = 0; l < num_levels; ++l) {
+        P->curve_mag_[l]->setRawSamples(freqs, &mags[l * n], n);
+        P->curve_phase_[l]->setRawSamples(freqs, &phases[l * n], n);
+        P->curve_thd_[l]->setRawSamples(freqs, &thd[l * n], n);
+        P->curve_thdn_[l]->setRawSamples(freqs, &thdn[l * n], n);
+
+        QVector<QPointF> noisy;
+        for (unsigned i = 0; i < n; ++i) {
+            if (coherence[l * n + i] < Analysis::coherence_min)
+                noisy.push_back(QPointF(freqs[i], mags[l * n + i]));
+        }
+        P->curve_noisy_[l]->setSamples(noisy);
+    }
 
     P->marker_mag_->setXValue(freqmark);
     P->marker_phase_->setXValue(freqmark);
@@ -228,3 +369,176 @@ void MainWindow::showPlotData(
     P->ui.pltAmplitude->replot();
     P->ui.pltPhase->replot();
 }
+
+void MainWindow::addReference(
+    const QString &name, const double *freqs,
+    const double *mags, const double *phases,
+    const double *level_db, unsigned num_levels, unsigned n)
+{
+    const unsigned live_levels = theApplication->numLevels();
+    for (unsigned l = 0; l < num_levels; ++l) {
+        // the color of the live level it matches, else gray
+        QColor color(Qt::lightGray);
+        for (unsigned k = 0; k < live_levels; ++k) {
+            if (std::abs(theApplication->driveLevel(k) - level_db[l]) < 0.01) {
+                double r = (live_levels > 1) ? ((double)k / (live_levels - 1)) : 0;
+                color = QColor::fromHsvF((1 - r) / 3, 1, 1);
+            }
+        }
+        color.setAlphaF(0.4);
+
+        QwtPlotCurve *curve_mag = new QwtPlotCurve(tr("%1 Reference").arg(name));
+        curve_mag->setItemAttribute(QwtPlotItem::Legend, l == 0);
+        curve_mag->setPen(color, 2.0, Qt::SolidLine);
+        curve_mag->setRawSamples(freqs, &mags[l * n], n);
+        curve_mag->setZ(curve_mag->z() - 1);
+        curve_mag->attach(P->ui.pltAmplitude);
+        P->curve_ref_.push_back(curve_mag);
+
+        QwtPlotCurve *curve_phase = new QwtPlotCurve(tr("%1 Reference").arg(name));
+        curve_phase->setItemAttribute(QwtPlotItem::Legend, l == 0);
+        curve_phase->setPen(color, 2.0, Qt::SolidLine);
+        curve_phase->setRawSamples(freqs, &phases[l * n], n);
+        curve_phase->setZ(curve_phase->z() - 1);
+        curve_phase->attach(P->ui.pltPhase);
+        P->curve_ref_.push_back(curve_phase);
+    }
+}
+
+void MainWindow::clearReferences()
+{
+    for (QwtPlotCurve *curve : P->curve_ref_)
+        delete curve;
+    P->curve_ref_.clear();
+}
+
+void MainWindow::showFilter(const double *freqs, const double *mags, unsigned num_levels, unsigned n, double error)
+{
+    num_levels = std::min<unsigned>(num_levels, P->curve_filter_.size());
+    for (unsigned l = 0; l < num_levels; ++l) {
+        QVector<QPointF> filter;
+        for (unsigned i = 0; i < n; ++i) {
+            if (!std::isnan(mags[l * n + i]))
+                filter.push_back(QPointF(freqs[i], mags[l * n + i]));
+        }
+        P->curve_filter_[l]->setSamples(filter);
+    }
+
+    QString text = tr("None");
+    if (!std::isnan(error))
+        text = QString::number(error, 'f', 2) + " dB";
+    P->ui.lbl_filterError->setText(text);
+}
+
+void MainWindow::showDifference(
+    const double *freqs, const double *mags, const double *phases,
+    unsigned num_levels, unsigned n, double deviation)
+{
+    num_levels = std::min<unsigned>(num_levels, P->curve_diff_mag_.size());
+    for (unsigned l = 0; l < num_levels; ++l) {
+        QVector<QPointF> diff_mag;
+        QVector<QPointF> diff_phase;
+        for (unsigned i = 0; i < n; ++i) {
+            if (!std::isnan(mags[l * n + i]))
+                diff_mag.push_back(QPointF(freqs[i], mags[l * n + i]));
+            if (!std::isnan(phases[l * n + i]))
+                diff_phase.push_back(QPointF(freqs[i], phases[l * n + i]));
+        }
+        P->curve_diff_mag_[l]->setSamples(diff_mag);
+        P->curve_diff_phase_[l]->setSamples(diff_phase);
+    }
+
+    QString text = tr("None");
+    if (!std::isnan(deviation))
+        text = QString::number(deviation, 'f', 2) + " dB";
+    P->ui.lbl_deviation->setText(text);
+}
+
+void MainWindow::Impl::setup_level_curves()
+{
+    for (QwtPlotCurve *curve : curve_mag_)
+        delete curve;
+    for (QwtPlotCurve *curve : curve_phase_)
+        delete curve;
+    for (QwtPlotCurve *curve : curve_thd_)
+        delete curve;
+    for (QwtPlotCurve *curve : curve_thdn_)
+        delete curve;
+    for (QwtPlotCurve *curve : curve_noisy_)
+        delete curve;
+    for (QwtPlotCurve *curve : curve_filter_)
+        delete curve;
+    for (QwtPlotCurve *curve : curve_diff_mag_)
+        delete curve;
+    for (QwtPlotCurve *curve : curve_diff_phase_)
+        delete curve;
+    curve_mag_.clear();
+    curve_phase_.clear();
+    curve_thd_.clear();
+    curve_thdn_.clear();
+    curve_noisy_.clear();
+    curve_filter_.clear();
+    curve_diff_mag_.clear();
+    curve_diff_phase_.clear();
+
+    static const QwtSymbol::Style symbols[] = {
+        QwtSymbol::Ellipse, QwtSymbol::Triangle, QwtSymbol::Rect, QwtSymbol::Diamond,
+        QwtSymbol::DTriangle, QwtSymbol::Star2, QwtSymbol::Cross, QwtSymbol::XCross,
+    };
+    const unsigned num_symbols = sizeof(symbols) / sizeof(symbols[0]);
+
+    const unsigned num_levels = theApplication->numLevels();
+    for (unsigned l = 0; l < num_levels; ++l) {
+        // from green at the lowest level to red at the highest
+        double r = (num_levels > 1) ? ((double)l / (num_levels - 1)) : 0;
+        QColor color = QColor::fromHsvF((1 - r) / 3, 1, 1);
+        QString level = QString::number(theApplication->driveLevel(l)) + " dB";
+
+        QwtPlotCurve *curve_mag = new QwtPlotCurve(tr("%1 Gain").arg(level));
+        curve_mag->attach(ui.pltAmplitude);
+        curve_mag->setPen(color, 0.0, Qt::SolidLine);
+        curve_mag_.push_back(curve_mag);
+
+        QwtPlotCurve *curve_phase = new QwtPlotCurve(tr("%1 Phase").arg(level));
+        curve_phase->setStyle(QwtPlotCurve::NoCurve);
+        QwtSymbol *sym_phase = new QwtSymbol(symbols[l % num_symbols], QBrush(Qt::transparent), QPen(color), QSize(6, 6));
+        curve_phase->setSymbol(sym_phase);
+        curve_phase->attach(ui.pltPhase);
+        curve_phase_.push_back(curve_phase);
+
+        QwtPlotCurve *curve_thd = new QwtPlotCurve(tr("%1 THD").arg(level));
+        curve_thd->setYAxis(QwtPlot::yRight);
+        curve_thd->attach(ui.pltAmplitude);
+        curve_thd->setPen(color, 0.0, Qt::DashLine);
+        curve_thd_.push_back(curve_thd);
+
+        QwtPlotCurve *curve_thdn = new QwtPlotCurve(tr("%1 THD+N").arg(level));
+        curve_thdn->setYAxis(QwtPlot::yRight);
+        curve_thdn->attach(ui.pltAmplitude);
+        curve_thdn->setPen(color, 0.0, Qt::DotLine);
+        curve_thdn_.push_back(curve_thdn);
+
+        QwtPlotCurve *curve_noisy = new QwtPlotCurve(tr("%1 Low coherence").arg(level));
+        curve_noisy->setStyle(QwtPlotCurve::NoCurve);
+        curve_noisy->setItemAttribute(QwtPlotItem::Legend, false);
+        QwtSymbol *sym_noisy = new QwtSymbol(QwtSymbol::XCross, QBrush(Qt::transparent), QPen(color), QSize(8, 8));
+        curve_noisy->setSymbol(sym_noisy);
+        curve_noisy->attach(ui.pltAmplitude);
+        curve_noisy_.push_back(curve_noisy);
+
+        QwtPlotCurve *curve_filter = new QwtPlotCurve(tr("%1 Filter").arg(level));
+        curve_filter->attach(ui.pltAmplitude);
+        curve_filter->setPen(color, 0.0, Qt::DashDotDotLine);
+        curve_filter_.push_back(curve_filter);
+
+        QwtPlotCurve *curve_diff_mag = new QwtPlotCurve(tr("%1 Difference").arg(level));
+        curve_diff_mag->attach(ui.pltAmplitude);
+        curve_diff_mag->setPen(color, 0.0, Qt::DashDotLine);
+        curve_diff_mag_.push_back(curve_diff_mag);
+
+        QwtPlotCurve *curve_diff_phase = new QwtPlotCurve(tr("%1 Difference").arg(level));
+        curve_diff_phase->attach(ui.pltPhase);
+        curve_diff_phase->setPen(color, 0.0, Qt::DashDotLine);
+        curve_diff_phase_.push_back(curve_diff_phase);
+    }
+}
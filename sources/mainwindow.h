@@ -16,10 +16,31 @@ public:
     void showCurrentFrequency(float f);
     void showLevels(float in, float out);
     void showProgress(float progress);
+    void showLatency(int latency); // samples, or -1 if failed
+    void showDriveLevels();
+    // the level-by-frequency matrices of magnitudes and phases, of the
+    // distortion ratios in dB, and of the coherence which marks the points
+    // too noisy to be reliable
     void showPlotData(
         const double *freqs, double freqmark,
-        const double *lo_mags, const double *lo_phases,
-        const double *hi_mags, const double *hi_phases, unsigned n);
+        const double *mags, const double *phases,
+        const double *thd, const double *thdn,
+        const float *coherence, unsigned num_levels, unsigned n);
+    // the level-by-frequency matrices of a reference, drawn faintly and kept
+    // in place, on its own frequencies and at its own levels in dB
+    void addReference(
+        const QString &name, const double *freqs,
+        const double *mags, const double *phases,
+        const double *level_db, unsigned num_levels, unsigned n);
+    void clearReferences();
+    // the gains in dB of the filters fitted to the responses, NaN where there
+    // is none, and the largest RMS error of the fits
+    void showFilter(const double *freqs, const double *mags, unsigned num_levels, unsigned n, double error);
+    // the difference of the measurement to the reference in dB and in
+    // radians, NaN where there is none, and the largest deviation in gain
+    void showDifference(
+        const double *freqs, const double *mags, const double *phases,
+        unsigned num_levels, unsigned n, double deviation);
 
 private:
     struct Impl;
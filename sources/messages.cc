@@ -4,10 +4,41 @@
 //          http://www.boost.org/LICENSE_1_0.txt)
 
 #include "messages.h"
+#include <algorithm>
 #include <cassert>
 
 namespace Messages {
 
+template <class T>
+static auto message_size(const T &msg, int) -> decltype(msg.size())
+{
+    return msg.size();
+}
+
+template <class T>
+static size_t message_size(const T &, long)
+{
+    return sizeof(T);
+}
+
+template <class T>
+static auto max_message_size(unsigned count, unsigned channels, int) -> decltype(T::size_for(count, channels))
+{
+    return T::size_for(count, channels);
+}
+
+template <class T>
+static auto max_message_size(unsigned count, unsigned, long) -> decltype(T::size_for(count))
+{
+    return T::size_for(count);
+}
+
+template <class T>
+static size_t max_message_size(unsigned, unsigned, ...)
+{
+    return sizeof(T);
+}
+
 size_t size_of(Message_Tag tag)
 {
     size_t size = 0;
@@ -21,13 +52,113 @@ size_t size_of(Message_Tag tag)
     return size;
 }
 
-uint8_t *allocate_buffer()
+size_t size_of(const Basic_Message &msg)
 {
     size_t size = 0;
-    #define COMPUTE_MAX(x) size = (size < sizeof(Messages::x)) ? sizeof(Messages::x) : size;
+    switch (msg.tag) {
+    #define HANDLE_CASE(x) case Message_Tag::x: size = message_size((const x &)msg, 0); break;
+    EACH_MESSAGE_TYPE(HANDLE_CASE)
+    #undef HANDLE_CASE
+    default:
+        assert(false);
+    }
+    return size;
+}
+
+size_t max_size_of(unsigned max_count, unsigned max_channels)
+{
+    size_t size = 0;
+    #define COMPUTE_MAX(x) size = std::max<size_t>(size, max_message_size<x>(max_count, max_channels, 0));
     EACH_MESSAGE_TYPE(COMPUTE_MAX)
     #undef COMPUTE_MAX
-    return new uint8_t[size];
+    return size;
+}
+
+uint8_t *allocate_buffer(unsigned max_count, unsigned max_channels)
+{
+    return new uint8_t[max_size_of(max_count, max_channels)];
+}
+
+size_t ring_capacity(size_t size)
+{
+    return payload_offset(size + 1) - 1;
+}
+
+static bool is_aligned(const void *ptr)
+{
+    return (uintptr_t)ptr % alignof(std::max_align_t) == 0;
+}
+
+static void copy_to_span(const Ring_Span<uint8_t> &span, const uint8_t *src, size_t size)
+{
+    const size_t taillen = std::min(size, span.size[0]);
+    std::copy_n(src, taillen, span.data[0]);
+    std::copy_n(src + taillen, size - taillen, span.data[1]);
+}
+
+// the span in place, or copied into the buffer if it wraps or is unaligned
+static const uint8_t *gather_span(const Ring_Span<const uint8_t> &span, uint8_t *buf)
+{
+    if (span.contiguous() && is_aligned(span.data[0]))
+        return span.data[0];
+    std::copy_n(span.data[0], span.size[0], buf);
+    std::copy_n(span.data[1], span.size[1], buf + span.size[0]);
+    return buf;
+}
+
+bool write(Ring_Buffer &rb, const Basic_Message &msg)
+{
+    const size_t size = size_of(msg);
+    Ring_Span<uint8_t> span;
+    if (!rb.reserve(payload_offset(size), span))
+        return false;
+    copy_to_span(span, (const uint8_t *)&msg, size);
+    rb.commit(payload_offset(size));
+    return true;
+}
+
+void *reserve_bytes(Ring_Buffer &rb, uint8_t *buf, size_t size)
+{
+    Ring_Span<uint8_t> span;
+    if (!rb.reserve(payload_offset(size), span))
+        return nullptr;
+    return (span.contiguous() && is_aligned(span.data[0])) ? span.data[0] : buf;
+}
+
+void commit(Ring_Buffer &rb, const Basic_Message &msg)
+{
+    // the room is still there, the writer being the only one to take it
+    const size_t size = size_of(msg);
+    Ring_Span<uint8_t> span;
+    bool reserved = rb.reserve(payload_offset(size), span);
+    assert(reserved);
+    (void)reserved;
+    if (span.data[0] != (const uint8_t *)&msg)
+        copy_to_span(span, (const uint8_t *)&msg, size);
+    rb.commit(payload_offset(size));
+}
+
+Basic_Message *read_in_place(Ring_Buffer &rb, uint8_t *buf)
+{
+    Ring_Span<const uint8_t> span;
+
+    // the tag, then the fixed part, which determines the size of the whole
+    if (!rb.read_span(sizeof(Basic_Message), span))
+        return nullptr;
+    const Basic_Message *head = (const Basic_Message *)gather_span(span, buf);
+
+    if (!rb.read_span(size_of(head->tag), span))
+        return nullptr;
+    head = (const Basic_Message *)gather_span(span, buf);
+
+    if (!rb.read_span(payload_offset(size_of(*head)), span))
+        return nullptr;
+    return (Basic_Message *)gather_span(span, buf);
+}
+
+void release(Ring_Buffer &rb, const Basic_Message &msg)
+{
+    rb.release(payload_offset(size_of(msg)));
 }
 
 }  // namespace Messages
@@ -5,14 +5,26 @@
 
 #pragma once
 #include "analyzerdefs.h"
+#include "utility/ring_buffer.h"
 #include <complex>
+#include <memory>
+#include <new>
 #include <cstddef>
 #include <cstdint>
 
 #define EACH_MESSAGE_TYPE(F)                    \
     F(RequestAnalyzeFrequency)                  \
+    F(RequestAnalyzeSweep)                      \
+    F(RequestAnalyzeMls)                        \
+    F(RequestSweepPlan)                         \
+    F(RequestRepeatStep)                        \
+    F(RequestMeasureLatency)                    \
     F(RequestStop)                              \
-    F(NotifyFrequencyAnalysis)
+    F(NotifyFrequencyAnalysis)                  \
+    F(NotifySweepAnalysis)                      \
+    F(NotifyMlsAnalysis)                        \
+    F(NotifyDistortion)                         \
+    F(NotifyLatency)
 
 enum class Message_Tag {
     #define DECLARE_MEMBER(x) x,
@@ -34,28 +46,226 @@ struct Basic_Message_T : public Basic_Message {
         : Basic_Message(Tag) {}
 };
 
+// Messages which carry arrays have them stored after the fixed part, sized
+// to the count held in the message, and for notifications to the number of
+// channels as well. `size_for` gives the total size of such a message for a
+// count, and `size` the total size of a given message.
 namespace Messages {
     #define DEFMESSAGE(t)                                   \
         struct t : public Basic_Message_T<Message_Tag::t>
 
+    template <class T> T *payload(void *msg, size_t offset);
+    size_t payload_offset(size_t fixed_size);
+
+    // the amplitude of the generator is of the drive level and the output
+    // gain, given with each request so that the processor shares no table
+    // of the levels with the requester; the serial is the requester's own,
+    // returned in the notifications, so that those of a request which has
+    // since been replaced are told apart
     DEFMESSAGE(RequestAnalyzeFrequency) {
+        unsigned serial;
+        int spl;
+        float amplitude;
+        unsigned index; // step of the sweep, returned in the notifications
+        int window;
+        unsigned averages; // frames of the capture, from 1
+        float gain;
+        unsigned num_bins;
+        // frequency in Hz, initial phase in cycles
+        float *frequency() { return payload<float>(this, payload_offset(sizeof(*this))); }
+        float *phase() { return frequency() + num_bins; }
+        static size_t size_for(unsigned count)
+            { return payload_offset(sizeof(RequestAnalyzeFrequency)) + 2 * count * sizeof(float); }
+        size_t size() const { return size_for(num_bins); }
+    };
+
+    DEFMESSAGE(RequestAnalyzeSweep) {
+        unsigned serial;
         int spl;
+        float amplitude;
+        unsigned num_points;
+        float *frequency() { return payload<float>(this, payload_offset(sizeof(*this))); }
+        static size_t size_for(unsigned count)
+            { return payload_offset(sizeof(RequestAnalyzeSweep)) + count * sizeof(float); }
+        size_t size() const { return size_for(num_points); }
+    };
+
+    DEFMESSAGE(RequestAnalyzeMls) {
+        unsigned serial;
+        int spl;
+        float amplitude;
+        unsigned num_points;
+        float *frequency() { return payload<float>(this, payload_offset(sizeof(*this))); }
+        static size_t size_for(unsigned count)
+            { return payload_offset(sizeof(RequestAnalyzeMls)) + count * sizeof(float); }
+        size_t size() const { return size_for(num_points); }
+    };
+
+    // the stepped sweep, walked by the processor from the first step until
+    // stopped: at each step every level in turn, then the next step, and
+    // the first after the last; a step measures its bins at once, spread
+    // over the points as by `nth_bin_position`, and the phases of the tones
+    // are designed by the processor; the amplitudes of the levels are those
+    // of the plan until it is replaced
+    DEFMESSAGE(RequestSweepPlan) {
+        unsigned serial;
+        int first_spl;
+        unsigned first_index;
+        unsigned num_levels;
+        float amplitude[Analysis::levels_max];
+        int window;
+        unsigned averages;
         unsigned num_bins;
-        float frequency[Analysis::max_bins_at_once];
+        unsigned num_points;
+        float *frequency() { return payload<float>(this, payload_offset(sizeof(*this))); }
+        static size_t size_for(unsigned count)
+            { return payload_offset(sizeof(RequestSweepPlan)) + count * sizeof(float); }
+        size_t size() const { return size_for(num_points); }
+    };
+
+    // a step of the plan measured again, ahead of the steps which remain;
+    // ignored unless of the serial of the plan
+    DEFMESSAGE(RequestRepeatStep) {
+        unsigned serial;
+        int spl;
+        unsigned index;
+    };
+
+    DEFMESSAGE(RequestMeasureLatency) {
+        unsigned serial;
+        int spl;
+        float amplitude;
     };
 
     DEFMESSAGE(RequestStop) {
     };
 
+    // the response is the H1 estimate over the frames, the cross-spectrum
+    // over the auto-spectrum of the excitation; with the coherence, which is
+    // 1 for a single frame, the H2 estimate is the response over coherence
     DEFMESSAGE(NotifyFrequencyAnalysis) {
+        unsigned serial;
+        int spl;
+        unsigned index;
+        unsigned num_channels;
+        unsigned num_bins;
+        std::complex<float> *response(unsigned c) { return payload<std::complex<float>>(this, payload_offset(sizeof(*this))) + c * num_bins; }
+        float *coherence(unsigned c) { return (float *)response(num_channels) + c * num_bins; }
+        float *frequency() { return coherence(num_channels); }
+        static size_t size_for(unsigned count, unsigned channels)
+            { return payload_offset(sizeof(NotifyFrequencyAnalysis)) + count * (channels * (sizeof(std::complex<float>) + sizeof(float)) + sizeof(float)); }
+        size_t size() const { return size_for(num_bins, num_channels); }
+    };
+
+    DEFMESSAGE(NotifySweepAnalysis) {
+        unsigned serial;
+        int spl;
+        unsigned num_channels;
+        unsigned num_points;
+        std::complex<float> *response(unsigned c) { return payload<std::complex<float>>(this, payload_offset(sizeof(*this))) + c * (1 + Analysis::ess_num_harmonics) * num_points; }
+        std::complex<float> *harmonic(unsigned c, unsigned h) { return response(c) + (h + 1) * num_points; }
+        float *frequency() { return (float *)response(num_channels); }
+        static size_t size_for(unsigned count, unsigned channels)
+            { return payload_offset(sizeof(NotifySweepAnalysis)) + count * (channels * (1 + Analysis::ess_num_harmonics) * sizeof(std::complex<float>) + sizeof(float)); }
+        size_t size() const { return size_for(num_points, num_channels); }
+    };
+
+    DEFMESSAGE(NotifyMlsAnalysis) {
+        unsigned serial;
+        int spl;
+        unsigned num_channels;
+        unsigned num_points;
+        std::complex<float> *response(unsigned c) { return payload<std::complex<float>>(this, payload_offset(sizeof(*this))) + c * num_points; }
+        float *frequency() { return (float *)response(num_channels); }
+        static size_t size_for(unsigned count, unsigned channels)
+            { return payload_offset(sizeof(NotifyMlsAnalysis)) + count * (channels * sizeof(std::complex<float>) + sizeof(float)); }
+        size_t size() const { return size_for(num_points, num_channels); }
+    };
+
+    // for each tone, the harmonics relative to the fundamental, in phase
+    // against that of the fundamental times the order; the total harmonic
+    // distortion, and with noise, as ratios to the fundamental; the RMS of
+    // the noise alone at the input
+    DEFMESSAGE(NotifyDistortion) {
+        unsigned serial;
         int spl;
+        unsigned index;
+        unsigned num_channels;
         unsigned num_bins;
-        float frequency[Analysis::max_bins_at_once];
-        std::complex<float> response[Analysis::max_bins_at_once];
+        std::complex<float> *harmonic(unsigned c, unsigned a) { return payload<std::complex<float>>(this, payload_offset(sizeof(*this))) + (c * num_bins + a) * Analysis::distortion_num_harmonics; }
+        float *thd(unsigned c) { return (float *)harmonic(num_channels, 0) + 3 * c * num_bins; }
+        float *thdn(unsigned c) { return thd(c) + num_bins; }
+        float *noise(unsigned c) { return thdn(c) + num_bins; }
+        float *frequency() { return thd(num_channels); }
+        static size_t size_for(unsigned count, unsigned channels)
+            { return payload_offset(sizeof(NotifyDistortion)) + count * (channels * (Analysis::distortion_num_harmonics * sizeof(std::complex<float>) + 3 * sizeof(float)) + sizeof(float)); }
+        size_t size() const { return size_for(num_bins, num_channels); }
+    };
+
+    DEFMESSAGE(NotifyLatency) {
+        unsigned serial;
+        unsigned latency; // samples
+        float peak; // magnitude of the impulse response at the latency
+        unsigned channel; // of the strongest response, which is retained
+        bool valid; // retained: strong enough, and distinct from the tail
     };
 
     #undef DEFMESSAGE
 
+    template <class T> inline T *payload(void *msg, size_t offset)
+    {
+        return reinterpret_cast<T *>(reinterpret_cast<uint8_t *>(msg) + offset);
+    }
+
+    inline size_t payload_offset(size_t fixed_size)
+    {
+        const size_t align = alignof(std::max_align_t);
+        return (fixed_size + align - 1) / align * align;
+    }
+
+    struct Deleter {
+        void operator()(void *msg) const { ::operator delete(msg); }
+    };
+
+    template <class T> using Message_Ptr = std::unique_ptr<T, Deleter>;
+
+    // a message with room for `count` elements in its arrays, and for as
+    // many channels if it is a notification; the counts themselves are left
+    // for the caller to set
+    template <class T, class... Counts> Message_Ptr<T> create(Counts... counts)
+    {
+        return Message_Ptr<T>(new (::operator new(T::size_for(counts...))) T);
+    }
+
     size_t size_of(Message_Tag tag);
-    uint8_t *allocate_buffer();
+    size_t size_of(const Basic_Message &msg);
+    size_t max_size_of(unsigned max_count, unsigned max_channels = 1);
+    uint8_t *allocate_buffer(unsigned max_count, unsigned max_channels = 1);
+
+    // the capacity of a ring buffer of messages, at least `size`: the
+    // messages are stored with their sizes rounded to the alignment, and
+    // with the storage in whole units of it, they are aligned in place
+    size_t ring_capacity(size_t size);
+
+    // transfer of a whole message by copy, returning false if there is not
+    // enough room in the ring buffer
+    bool write(Ring_Buffer &rb, const Basic_Message &msg);
+
+    // in-place transfer: a message for the counts is composed in the ring
+    // buffer if it has contiguous room there, or else in `buf`, and `commit`
+    // publishes it, copying it from `buf` in the latter case; null if there
+    // is not enough room
+    void *reserve_bytes(Ring_Buffer &rb, uint8_t *buf, size_t size);
+    template <class T, class... Counts> T *reserve(Ring_Buffer &rb, uint8_t *buf, Counts... counts)
+    {
+        void *msg = reserve_bytes(rb, buf, T::size_for(counts...));
+        return msg ? new (msg) T : nullptr;
+    }
+    void commit(Ring_Buffer &rb, const Basic_Message &msg);
+
+    // the next message, in place in the ring buffer if it is contiguous
+    // there, or else copied into `buf`, which belongs to the reader until
+    // `release`; null if there is not a whole message
+    Basic_Message *read_in_place(Ring_Buffer &rb, uint8_t *buf);
+    void release(Ring_Buffer &rb, const Basic_Message &msg);
 }
@@ -0,0 +1,141 @@
+//          Copyright Jean Pierre Cimalando 2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "mlsanalyzer.h"
+#include <stdexcept>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+typedef std::complex<float> cfloat;
+typedef std::complex<double> cdouble;
+
+// primitive polynomials x^m + ... + 1 by order m, as the mask of the terms
+// below x^m
+static const uint32_t mls_taps[] = {
+    0, 0, 0x3, 0x3, 0x3, 0x5, 0x3, 0x3, 0x71, 0x11, 0x9,
+    0x5, 0x53, 0x1b, 0x443, 0x3, 0xa011, 0x9, 0x81, 0x27, 0x9,
+};
+
+Mls_Analyzer::Mls_Analyzer(float sample_rate, unsigned order)
+{
+    if (order < 2 || order >= sizeof(mls_taps) / sizeof(mls_taps[0]))
+        throw std::out_of_range("Mls_Analyzer: unsupported order");
+
+    const uint32_t taps = mls_taps[order];
+    const unsigned len = (1u << order) - 1;
+
+    sample_rate_ = sample_rate;
+    order_ = order;
+    length_ = len;
+
+    float *signal = new float[len];
+    signal_.reset(signal);
+    unsigned *perm_in = new unsigned[len];
+    perm_in_.reset(perm_in);
+    unsigned *perm_out = new unsigned[len];
+    perm_out_.reset(perm_out);
+    work_.reset(new double[len + 1]);
+    ir_.reset(new double[len]);
+
+    // the state holds the next `order` bits of the sequence, the bit j
+    // being s[n+j], and visits every nonzero value over the period
+    uint32_t state = 1;
+    for (unsigned n = 0; n < len; ++n) {
+        signal[n] = (state & 1) ? -1 : +1;
+        perm_in[n] = state;
+        uint32_t bit = __builtin_parity(state & taps);
+        state = (state >> 1) | (bit << (order - 1));
+    }
+
+    // s[n-k] is a linear form of the state at n; the form for the offset
+    // d follows the recurrence of the sequence, from s[n+d] = bit d for the
+    // first `order` offsets
+    std::unique_ptr<uint32_t[]> forms(new uint32_t[len]);
+    for (unsigned d = 0; d < len; ++d) {
+        uint32_t form = 0;
+        if (d < order)
+            form = 1u << d;
+        else {
+            for (unsigned e = 0; e < order; ++e) {
+                if (taps & (1u << e))
+                    form ^= forms[d - order + e];
+            }
+        }
+        forms[d] = form;
+    }
+    for (unsigned k = 0; k < len; ++k)
+        perm_out[k] = forms[(len - k) % len];
+}
+
+Mls_Analyzer::~Mls_Analyzer()
+{
+}
+
+const float *Mls_Analyzer::signal() const
+{
+    return signal_.get();
+}
+
+unsigned Mls_Analyzer::length() const
+{
+    return length_;
+}
+
+const double *Mls_Analyzer::deconvolve(const float *capture, float amplitude)
+{
+    const unsigned len = length_;
+    const unsigned size = len + 1;
+    double *work = work_.get();
+    double *ir = ir_.get();
+    const unsigned *perm_in = perm_in_.get();
+    const unsigned *perm_out = perm_out_.get();
+
+    work[0] = 0;
+    for (unsigned n = 0; n < len; ++n)
+        work[perm_in[n]] = capture[n];
+
+    // fast Walsh-Hadamard transform, in place
+    for (unsigned half = 1; half < size; half *= 2) {
+        for (unsigned i = 0; i < size; i += 2 * half) {
+            for (unsigned j = i; j < i + half; ++j) {
+                double a = work[j];
+                double b = work[j + half];
+                work[j] = a + b;
+                work[j + half] = a - b;
+            }
+        }
+    }
+
+    // the circular autocorrelation of the sequence is N+1 at the origin
+    // and -1 elsewhere: restore the DC part which the latter removes
+    double sum = 0;
+    for (unsigned k = 0; k < len; ++k)
+        sum += ir[k] = work[perm_out[k]];
+    const double scale = 1 / ((double)size * amplitude);
+    for (unsigned k = 0; k < len; ++k)
+        ir[k] = (ir[k] + sum) * scale;
+
+    return ir;
+}
+
+void Mls_Analyzer::analyze(
+    const float *capture, float amplitude,
+    const float *freqs, unsigned count, cfloat *response)
+{
+    const unsigned len = length_;
+    const double *ir = deconvolve(capture, amplitude);
+
+    for (unsigned i = 0; i < count; ++i) {
+        const double w = 2 * M_PI * freqs[i] / sample_rate_;
+        const cdouble rot = std::polar(1.0, -w);
+        cdouble osc = 1;
+        cdouble acc = 0;
+        for (unsigned k = 0; k < len; ++k) {
+            acc += ir[k] * osc;
+            osc *= rot;
+        }
+        response[i] = acc;
+    }
+}
@@ -0,0 +1,42 @@
+//          Copyright Jean Pierre Cimalando 2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+#include <memory>
+#include <complex>
+
+// Maximum-length sequence measurement, after Borish and Angell (1983).
+// One period of the steady-state capture is the circular convolution of the
+// sequence with the impulse response, which the fast Hadamard transform
+// recovers in O(N log N) between a permutation of the capture and a
+// permutation of the result.
+class Mls_Analyzer {
+public:
+    Mls_Analyzer(float sample_rate, unsigned order);
+    ~Mls_Analyzer();
+
+    const float *signal() const; // one period, of values ±1
+    unsigned length() const; // 2^order - 1
+
+    // recover the circular impulse response, of the sequence length, from
+    // one period of capture which starts in phase with the sequence
+    const double *deconvolve(const float *capture, float amplitude);
+
+    // compute the response at each frequency, from one period of capture
+    void analyze(
+        const float *capture, float amplitude,
+        const float *freqs, unsigned count, std::complex<float> *response);
+
+private:
+    float sample_rate_ = 0;
+    unsigned order_ = 0;
+    unsigned length_ = 0;
+
+    std::unique_ptr<float[]> signal_;
+    std::unique_ptr<unsigned[]> perm_in_;
+    std::unique_ptr<unsigned[]> perm_out_;
+    std::unique_ptr<double[]> work_;
+    std::unique_ptr<double[]> ir_;
+};
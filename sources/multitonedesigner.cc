@@ -0,0 +1,156 @@
+//          Copyright Jean Pierre Cimalando 2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "multitonedesigner.h"
+#include <algorithm>
+#include <vector>
+#include <new>
+#include <cmath>
+typedef std::complex<float> cfloat;
+
+Multitone_Designer::Multitone_Designer(unsigned fft_size)
+{
+    fft_size_ = fft_size;
+
+    real_.reset(fftwf_alloc_real(fft_size));
+    cplx_.reset((cfloat *)fftwf_alloc_complex(fft_size / 2 + 1));
+    if (!real_ || !cplx_)
+        throw std::bad_alloc();
+
+    plan_forward_.reset(fftwf_plan_dft_r2c_1d(fft_size, real_.get(), (fftwf_complex *)cplx_.get(), FFTW_ESTIMATE));
+    plan_backward_.reset(fftwf_plan_dft_c2r_1d(fft_size, (fftwf_complex *)cplx_.get(), real_.get(), FFTW_ESTIMATE));
+    if (!plan_forward_ || !plan_backward_)
+        throw std::bad_alloc();
+}
+
+Multitone_Designer::~Multitone_Designer()
+{
+}
+
+float Multitone_Designer::design(const unsigned *bins, unsigned count, float *phases, unsigned iterations)
+{
+    if (count == 0)
+        return 1;
+
+    std::vector<unsigned> tones;
+    tones.reserve(count);
+    for (unsigned a = 0; a < count; ++a) {
+        if (a == 0 || bins[a] != bins[a - 1])
+            tones.push_back(a);
+    }
+
+    // Schroeder phases, generalized to arbitrary bins: the group delay of
+    // each tone is the share of power of the tones below it, spreading the
+    // tones over the period like a sweep. For harmonic tones this reduces
+    // to φk = -πk(k-1)/K.
+    const unsigned num_tones = tones.size();
+    std::sort(tones.begin(), tones.end(), [bins](unsigned a, unsigned b) { return bins[a] < bins[b]; });
+    double phase = 0;
+    for (unsigned k = 0; k < num_tones; ++k) {
+        if (k > 0)
+            phase -= (double)(bins[tones[k]] - bins[tones[k - 1]]) * k / num_tones;
+        phase -= std::floor(phase);
+        phases[tones[k]] = phase;
+    }
+
+    // descend the Lp norm of the signal, which approaches the peak as p
+    // grows; its gradient with respect to the phases is the spectrum of
+    // x^(p-1) at the bins of the tones
+    const unsigned n = fft_size_;
+    float *real = real_.get();
+    cfloat *cplx = cplx_.get();
+    std::vector<float> best(phases, phases + count);
+    std::vector<float> trial(phases, phases + count);
+    std::vector<float> grad(count);
+    float best_peak = synthesize(bins, count, phases);
+    const float scale = 1 / best_peak;
+
+    unsigned p = 4;
+    double cost = lp_cost(p, scale);
+    double step = 0.01;
+    for (unsigned it = 0; it < iterations && num_tones > 1; ++it) {
+        for (unsigned i = 0; i < n; ++i) {
+            float u = real[i] * scale;
+            real[i] = std::pow(u, p - 1);
+        }
+        fftwf_execute(plan_forward_.get());
+        float max_grad = 0;
+        for (unsigned k = 0; k < num_tones; ++k) {
+            unsigned a = tones[k];
+            float g = -std::imag(std::conj(cplx[bins[a]]) * std::polar(1.0f, 2 * (float)M_PI * phases[a]));
+            grad[a] = g;
+            max_grad = std::max(max_grad, std::abs(g));
+        }
+        if (max_grad == 0)
+            break;
+
+        for (;;) {
+            for (unsigned k = 0; k < num_tones; ++k) {
+                unsigned a = tones[k];
+                trial[a] = phases[a] - step * grad[a] / max_grad;
+            }
+            float peak = synthesize(bins, count, trial.data());
+            double trial_cost = lp_cost(p, scale);
+            if (trial_cost < cost || step < 1e-6) {
+                std::copy(trial.begin(), trial.end(), phases);
+                cost = trial_cost;
+                step *= 1.5;
+                if (peak < best_peak) {
+                    best_peak = peak;
+                    std::copy_n(phases, count, best.begin());
+                }
+                break;
+            }
+            step *= 0.5;
+        }
+
+        // sharpen the norm toward the peak as the descent progresses
+        if (p < 64 && (it + 1) % (iterations / 5 + 1) == 0) {
+            p *= 2;
+            synthesize(bins, count, phases);
+            cost = lp_cost(p, scale);
+        }
+    }
+
+    for (unsigned a = 0; a < count; ++a) {
+        bool duplicate = a > 0 && bins[a] == bins[a - 1];
+        phases[a] = duplicate ? phases[a - 1] : (best[a] - std::floor(best[a]));
+    }
+
+    return 1 / best_peak;
+}
+
+double Multitone_Designer::lp_cost(unsigned p, float scale) const
+{
+    const unsigned n = fft_size_;
+    const float *real = real_.get();
+    double sum = 0;
+    for (unsigned i = 0; i < n; ++i)
+        sum += std::pow(real[i] * scale, p);
+    return sum;
+}
+
+float Multitone_Designer::synthesize(const unsigned *bins, unsigned count, const float *phases)
+{
+    // the sum of cosines over one period, into the real buffer
+    const unsigned n = fft_size_;
+    float *real = real_.get();
+    cfloat *cplx = cplx_.get();
+
+    std::fill_n(cplx, n / 2 + 1, 0);
+    for (unsigned a = 0; a < count; ++a) {
+        unsigned bin = bins[a];
+        if (a > 0 && bin == bins[a - 1])
+            continue;
+        float mag = (bin == 0 || bin == n / 2) ? 1.0f : 0.5f;
+        cplx[bin] = std::polar(mag, 2 * (float)M_PI * phases[a]);
+    }
+    fftwf_execute(plan_backward_.get());
+
+    float peak = 0;
+    for (unsigned i = 0; i < n; ++i)
+        peak = std::max(peak, std::abs(real[i]));
+    return peak;
+}
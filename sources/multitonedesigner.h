@@ -0,0 +1,36 @@
+//          Copyright Jean Pierre Cimalando 2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+#include "utility/fftw_memory.h"
+#include <memory>
+#include <complex>
+
+// Phases of a sum of equal-amplitude tones placed on FFT bins, chosen for a
+// low crest factor: the formula of Schroeder (1970) gives the starting
+// point, refined by a gradient descent of the Lp norm of the signal, with p
+// raised toward the peak as the descent goes on.
+// A tone on the same bin as the tone before it is a duplicate, which is
+// generated once and takes the same phase.
+class Multitone_Designer {
+public:
+    explicit Multitone_Designer(unsigned fft_size);
+    ~Multitone_Designer();
+
+    // compute the initial phase of each tone in cycles, and return the gain
+    // which brings the peak of the sum of tones to unity
+    float design(const unsigned *bins, unsigned count, float *phases, unsigned iterations = 30);
+
+private:
+    float synthesize(const unsigned *bins, unsigned count, const float *phases);
+    double lp_cost(unsigned p, float scale) const;
+
+private:
+    unsigned fft_size_ = 0;
+    std::unique_ptr<float[], Fftwf_Deleter> real_;
+    std::unique_ptr<std::complex<float>[], Fftwf_Deleter> cplx_;
+    std::unique_ptr<fftwf_plan_s, Fftwf_Plan_Deleter> plan_forward_;
+    std::unique_ptr<fftwf_plan_s, Fftwf_Plan_Deleter> plan_backward_;
+};
@@ -0,0 +1,178 @@
+//          Copyright Jean Pierre Cimalando 2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "offlinebackend.h"
+#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+Loopback_Device::Loopback_Device(float gain, unsigned latency, float cutoff)
+    : gain_(gain),
+      delay_(new float[latency + 1]()),
+      delay_len_(latency + 1)
+{
+    if (cutoff > 0)
+        lp_coef_ = std::exp(-2 * (float)M_PI * cutoff);
+}
+
+void Loopback_Device::process(const float *gen, float *meas, unsigned n)
+{
+    const float gain = gain_;
+    const float lp_coef = lp_coef_;
+    float lp_mem = lp_mem_;
+    float *delay = delay_.get();
+    const unsigned len = delay_len_;
+    unsigned pos = delay_pos_;
+
+    for (unsigned i = 0; i < n; ++i) {
+        delay[pos] = gen[i];
+        pos = (pos + 1 < len) ? (pos + 1) : 0;
+        float x = gain * delay[pos];
+        lp_mem = x + lp_coef * (lp_mem - x);
+        meas[i] = lp_mem;
+    }
+
+    lp_mem_ = lp_mem;
+    delay_pos_ = pos;
+}
+
+File_Device::File_Device(const char *path)
+{
+    std::ifstream file(path, std::ios::binary|std::ios::ate);
+    if (!file)
+        return;
+
+    size_t size = (size_t)file.tellg() / sizeof(float);
+    file.seekg(0);
+
+    float *data = new float[size];
+    data_.reset(data);
+    if (!file.read((char *)data, size * sizeof(float)))
+        return;
+
+    size_ = size;
+    valid_ = true;
+}
+
+File_Device::operator bool() const
+{
+    return valid_;
+}
+
+void File_Device::process(const float *, float *meas, unsigned n)
+{
+    const float *data = data_.get();
+    size_t pos = pos_;
+
+    unsigned count = (unsigned)std::min<size_t>(n, size_ - pos);
+    std::copy_n(&data[pos], count, meas);
+    std::fill_n(&meas[count], n - count, 0);
+
+    pos_ = pos + count;
+}
+
+Offline_Backend::Offline_Backend(float sample_rate, unsigned buffer_size, unsigned channels)
+    : sample_rate_(sample_rate),
+      buffer_size_(buffer_size),
+      channels_(channels),
+      device_(new std::unique_ptr<Offline_Device>[channels]),
+      in_(new float[channels * buffer_size]()),
+      out_(new float[channels * buffer_size]()),
+      in_ptr_(new const float *[channels]),
+      out_ptr_(new float *[channels])
+{
+    for (unsigned c = 0; c < channels; ++c) {
+        in_ptr_[c] = &in_[c * buffer_size];
+        out_ptr_[c] = &out_[c * buffer_size];
+    }
+}
+
+Offline_Backend::~Offline_Backend()
+{
+    stop();
+}
+
+void Offline_Backend::set_device(std::unique_ptr<Offline_Device> device, unsigned channel)
+{
+    device_[channel] = std::move(device);
+}
+
+void Offline_Backend::set_realtime(bool realtime)
+{
+    realtime_ = realtime;
+}
+
+float Offline_Backend::sample_rate() const
+{
+    return sample_rate_;
+}
+
+unsigned Offline_Backend::buffer_size() const
+{
+    return buffer_size_;
+}
+
+unsigned Offline_Backend::num_channels() const
+{
+    return channels_;
+}
+
+void Offline_Backend::start(Process_Fn *fn, void *data)
+{
+    stop();
+    cb_fn_ = fn;
+    cb_data_ = data;
+    running_ = true;
+    thread_ = std::thread([this]() { run_thread(); });
+}
+
+void Offline_Backend::stop()
+{
+    running_ = false;
+    if (thread_.joinable())
+        thread_.join();
+}
+
+void Offline_Backend::run_cycles(Process_Fn *fn, void *data, unsigned count)
+{
+    for (unsigned i = 0; i < count; ++i)
+        run_cycle(fn, data);
+}
+
+void Offline_Backend::run_cycle(Process_Fn *fn, void *data)
+{
+    const unsigned n = buffer_size_;
+    const unsigned channels = channels_;
+
+    if (fn)
+        fn(in_ptr_.get(), out_ptr_.get(), n, data);
+    else
+        std::fill_n(out_.get(), channels * n, 0);
+
+    for (unsigned c = 0; c < channels; ++c) {
+        float *in = &in_[c * n];
+        float *out = &out_[c * n];
+        if (device_[c])
+            device_[c]->process(out, in, n);
+        else
+            std::copy_n(out, n, in);
+    }
+}
+
+void Offline_Backend::run_thread()
+{
+    typedef std::chrono::steady_clock clock;
+    const std::chrono::duration<double> period(buffer_size_ / sample_rate_);
+    clock::time_point deadline = clock::now();
+
+    while (running_) {
+        run_cycle(cb_fn_, cb_data_);
+        if (realtime_) {
+            deadline += std::chrono::duration_cast<clock::duration>(period);
+            std::this_thread::sleep_until(deadline);
+        }
+    }
+}
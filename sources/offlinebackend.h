@@ -0,0 +1,90 @@
+//          Copyright Jean Pierre Cimalando 2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+#include "audiobackend.h"
+#include <memory>
+#include <thread>
+#include <atomic>
+
+// The device under test, as seen by the offline backend: it turns the
+// generator output of a period into the measurement input of the next one.
+class Offline_Device {
+public:
+    virtual ~Offline_Device() {}
+    virtual void process(const float *gen, float *meas, unsigned n) = 0;
+};
+
+// A simulated device: gain, pure delay and a first-order lowpass.
+// The cutoff is normalized to the sample rate, 0 disables the lowpass.
+class Loopback_Device : public Offline_Device {
+public:
+    Loopback_Device(float gain, unsigned latency, float cutoff = 0);
+    void process(const float *gen, float *meas, unsigned n) override;
+
+private:
+    float gain_ = 1;
+    float lp_coef_ = 0;
+    float lp_mem_ = 0;
+    std::unique_ptr<float[]> delay_;
+    unsigned delay_len_ = 0;
+    unsigned delay_pos_ = 0;
+};
+
+// A recorded device: plays a raw mono float32 file, silence after the end.
+class File_Device : public Offline_Device {
+public:
+    explicit File_Device(const char *path);
+    explicit operator bool() const;
+    void process(const float *gen, float *meas, unsigned n) override;
+
+private:
+    std::unique_ptr<float[]> data_;
+    size_t size_ = 0;
+    size_t pos_ = 0;
+    bool valid_ = false;
+};
+
+class Offline_Backend : public Audio_Backend {
+public:
+    Offline_Backend(float sample_rate, unsigned buffer_size, unsigned channels = 1);
+    ~Offline_Backend();
+
+    // the device of a channel, which is a plain loopback without one
+    void set_device(std::unique_ptr<Offline_Device> device, unsigned channel = 0);
+    void set_realtime(bool realtime);
+
+    float sample_rate() const override;
+    unsigned buffer_size() const override;
+    unsigned num_channels() const override;
+
+    void start(Process_Fn *fn, void *data) override;
+    void stop() override;
+
+    // synchronous driving of a callback, for use while not started
+    void run_cycles(Process_Fn *fn, void *data, unsigned count);
+
+private:
+    void run_cycle(Process_Fn *fn, void *data);
+    void run_thread();
+
+private:
+    float sample_rate_ = 0;
+    unsigned buffer_size_ = 0;
+    unsigned channels_ = 0;
+    bool realtime_ = false;
+
+    std::unique_ptr<std::unique_ptr<Offline_Device>[]> device_;
+    std::unique_ptr<float[]> in_;
+    std::unique_ptr<float[]> out_;
+    std::unique_ptr<const float *[]> in_ptr_;
+    std::unique_ptr<float *[]> out_ptr_;
+
+    Process_Fn *cb_fn_ = nullptr;
+    void *cb_data_ = nullptr;
+
+    std::thread thread_;
+    std::atomic<bool> running_{false};
+};
@@ -0,0 +1,631 @@
+//          Copyright Jean Pierre Cimalando 2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "profile.h"
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+typedef std::complex<float> cfloat;
+
+namespace Profile {
+
+static const char magic[8] = {'P', 'R', 'O', 'F', 'A', 'M', 'P', 'L'};
+static const uint32_t byte_order_mark = 0x01020304;
+
+// guards the sizes against overflow, far beyond any sweep
+enum { max_points = 1 << 24 };
+
+static uint64_t align_offset(uint64_t offset)
+{
+    return (offset + column_align - 1) / column_align * column_align;
+}
+
+void init_header(Header &hdr)
+{
+    std::memset(&hdr, 0, sizeof(hdr));
+    std::memcpy(hdr.magic, magic, sizeof(magic));
+    hdr.byte_order = byte_order_mark;
+    hdr.version = version;
+    hdr.header_size = sizeof(Header);
+}
+
+size_t column_size(const Header &hdr, Column col)
+{
+    const size_t points = hdr.num_points;
+    const size_t matrix = (size_t)hdr.num_channels * hdr.num_levels * points;
+
+    switch (col) {
+    case Column_Frequency:
+        return points * sizeof(double);
+    case Column_Response:
+        return matrix * sizeof(cfloat);
+    case Column_Harmonics:
+        return matrix * Analysis::ess_num_harmonics * sizeof(cfloat);
+    case Column_Distortion:
+        return matrix * Analysis::distortion_num_harmonics * sizeof(cfloat);
+    case Column_Coherence:
+    case Column_Thd:
+    case Column_Thdn:
+    case Column_Noise:
+        return matrix * sizeof(float);
+    default:
+        return 0;
+    }
+}
+
+bool write(const std::string &path, const Header &hdr_in, const void *const columns[Column_Count])
+{
+    Header hdr = hdr_in;
+    std::fill_n(hdr.column, (size_t)max_columns, Header::Entry{0, 0});
+
+    uint64_t offset = align_offset(sizeof(Header));
+    for (unsigned col = 0; col < Column_Count; ++col) {
+        if (!columns[col])
+            continue;
+        uint64_t size = column_size(hdr, (Column)col);
+        hdr.column[col] = Header::Entry{offset, size};
+        offset = align_offset(offset + size);
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    file.write((const char *)&hdr, sizeof(hdr));
+
+    // zeros up to the alignment of each column
+    static const char padding[column_align] = {};
+    uint64_t pos = sizeof(hdr);
+    for (unsigned col = 0; col < Column_Count; ++col) {
+        const Header::Entry &entry = hdr.column[col];
+        if (!columns[col])
+            continue;
+        file.write(padding, entry.offset - pos);
+        file.write((const char *)columns[col], entry.size);
+        pos = entry.offset + entry.size;
+    }
+
+    return (bool)file.flush();
+}
+
+//------------------------------------------------------------------------------
+static std::string channel_suffix(const Header &hdr, unsigned channel)
+{
+    // a single channel keeps the names without a channel number
+    if (hdr.num_channels <= 1)
+        return std::string();
+    return "-ch" + std::to_string(channel + 1);
+}
+
+static std::string level_base(const Header &hdr, unsigned channel, unsigned level)
+{
+    char name[64];
+    std::snprintf(name, sizeof(name), "%gdB", hdr.level_db[level]);
+    return name + channel_suffix(hdr, channel);
+}
+
+bool write_dat(const std::string &dir, const Header &hdr, const void *const columns[Column_Count])
+{
+    const unsigned ns = hdr.num_points;
+    const unsigned channels = hdr.num_channels;
+    const unsigned levels = hdr.num_levels;
+
+    const double *freqs = (const double *)columns[Column_Frequency];
+    const cfloat *responses = (const cfloat *)columns[Column_Response];
+    const float *coherences = (const float *)columns[Column_Coherence];
+    const cfloat *harmonics = (const cfloat *)columns[Column_Harmonics];
+    const cfloat *distortion = (const cfloat *)columns[Column_Distortion];
+    const float *thd = (const float *)columns[Column_Thd];
+    const float *thdn = (const float *)columns[Column_Thdn];
+    const float *noise = (const float *)columns[Column_Noise];
+    if (!freqs || !responses)
+        return false;
+
+    auto row = [&](unsigned c, unsigned l) -> size_t { return ((size_t)c * levels + l) * ns; };
+
+    for (unsigned c = 0; c < channels; ++c) {
+        // the level-by-frequency map: a line by frequency, of the magnitude
+        // and the phase at each level
+        {
+            std::ofstream file(dir + "/map" + channel_suffix(hdr, c) + ".dat");
+            file << "# levels (dB):";
+            for (unsigned l = 0; l < levels; ++l)
+                file << ' ' << hdr.level_db[l];
+            file << '\n';
+            file << std::scientific << std::setprecision(10);
+            for (unsigned i = 0; i < ns; ++i) {
+                file << freqs[i];
+                for (unsigned l = 0; l < levels; ++l) {
+                    cfloat response = responses[row(c, l) + i];
+                    file << ' ' << std::abs(response) << ' ' << std::arg(response);
+                }
+                file << '\n';
+            }
+            if (!file.flush())
+                return false;
+        }
+
+        for (unsigned l = 0; l < levels; ++l) {
+            const std::string base = level_base(hdr, c, l);
+
+            // the coherence follows the response, 1 if not estimated
+            std::ofstream file(dir + "/" + base + ".dat");
+            file << std::scientific << std::setprecision(10);
+            for (unsigned i = 0; i < ns; ++i) {
+                cfloat response = responses[row(c, l) + i];
+                float coherence = coherences ? coherences[row(c, l) + i] : 1;
+                file << freqs[i] << ' ' << std::abs(response) << ' ' << std::arg(response) << ' ' << coherence << '\n';
+            }
+            if (!file.flush())
+                return false;
+
+            // the distortion of the stepped sine: a line by frequency, of the
+            // ratios and the noise, then the magnitude and the phase of each
+            // harmonic
+            if (distortion && thd && thdn && noise && (hdr.distortion_mask & (1u << l))) {
+                std::ofstream file(dir + "/" + base + "-distortion.dat");
+                file << "# frequency, THD, THD+N, noise, H2 to H"
+                     << 1 + Analysis::distortion_num_harmonics << '\n';
+                file << std::scientific << std::setprecision(10);
+                for (unsigned i = 0; i < ns; ++i) {
+                    const size_t offset = row(c, l) + i;
+                    file << freqs[i] << ' ' << thd[offset] << ' ' << thdn[offset] << ' ' << noise[offset];
+                    const cfloat *h = &distortion[offset * Analysis::distortion_num_harmonics];
+                    for (unsigned k = 0; k < Analysis::distortion_num_harmonics; ++k)
+                        file << ' ' << std::abs(h[k]) << ' ' << std::arg(h[k]);
+                    file << '\n';
+                }
+                if (!file.flush())
+                    return false;
+            }
+
+            if (!harmonics || !(hdr.harmonics_mask & (1u << l)))
+                continue;
+            for (unsigned h = 0; h < Analysis::ess_num_harmonics; ++h) {
+                std::ofstream file(dir + "/" + base + "-h" + std::to_string(h + 2) + ".dat");
+                file << std::scientific << std::setprecision(10);
+                for (unsigned i = 0; i < ns; ++i) {
+                    cfloat response = harmonics[row(c, l) * Analysis::ess_num_harmonics + h * ns + i];
+                    file << freqs[i] << ' ' << std::abs(response) << ' ' << std::arg(response) << '\n';
+                }
+                if (!file.flush())
+                    return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool write_filter(const std::string &dir, const Header &hdr, unsigned channel, unsigned level,
+                  const double *b, unsigned nb, const double *a, unsigned na)
+{
+    std::ofstream file(dir + "/" + level_base(hdr, channel, level) + "-filter.dat");
+    file << "# numerator, then denominator\n";
+    file << std::scientific << std::setprecision(16);
+    for (unsigned i = 0; i < nb; ++i)
+        file << (i ? " " : "") << b[i];
+    file << '\n';
+    for (unsigned i = 0; i < na; ++i)
+        file << (i ? " " : "") << a[i];
+    file << '\n';
+    return (bool)file.flush();
+}
+
+//------------------------------------------------------------------------------
+static bool file_exists(const std::string &path)
+{
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+}
+
+// the numbers of a line, false if it is a comment or blank
+static bool parse_line(const std::string &line, std::vector<double> &values)
+{
+    values.clear();
+    const char *p = line.c_str();
+    while (*p == ' ' || *p == '\t')
+        ++p;
+    if (*p == '#' || *p == '\0')
+        return false;
+    for (;;) {
+        char *end;
+        double value = std::strtod(p, &end);
+        if (end == p)
+            break;
+        values.push_back(value);
+        p = end;
+    }
+    return !values.empty();
+}
+
+// the lines of a file, each of at least `width` numbers, of which the
+// first ones are kept, row after row
+static bool read_rows(const std::string &path, unsigned width, std::vector<double> &rows)
+{
+    std::ifstream file(path);
+    if (!file)
+        return false;
+    rows.clear();
+    std::string line;
+    std::vector<double> values;
+    while (std::getline(file, line)) {
+        if (!parse_line(line, values))
+            continue;
+        if (values.size() < width)
+            return false;
+        rows.insert(rows.end(), values.begin(), values.begin() + width);
+    }
+    return true;
+}
+
+void Data::get_columns(const void *columns[Column_Count]) const
+{
+    columns[Column_Frequency] = frequency.get();
+    columns[Column_Response] = response.get();
+    columns[Column_Coherence] = coherence.get();
+    columns[Column_Harmonics] = harmonics.get();
+    columns[Column_Distortion] = distortion.get();
+    columns[Column_Thd] = thd.get();
+    columns[Column_Thdn] = thdn.get();
+    columns[Column_Noise] = noise.get();
+}
+
+// the profile of the first versions: a response file per level, "lo.dat"
+// at -40 dB and "hi.dat" at 0 dB, each of which may be absent, with lines
+// of the frequency, the magnitude and the phase
+static bool read_legacy_dat(const std::string &dir, Data &data)
+{
+    Header &hdr = data.header;
+
+    static const char *const names[] = {"lo", "hi"};
+    static const double levels_db[] = {-40, 0};
+    const unsigned count = sizeof(names) / sizeof(*names);
+
+    std::vector<double> level_rows[count];
+    unsigned levels = 0;
+    unsigned first = count;
+    for (unsigned r = 0; r < count; ++r) {
+        const std::string path = dir + "/" + names[r] + ".dat";
+        if (!file_exists(path))
+            continue;
+        if (!read_rows(path, 3, level_rows[r]) || level_rows[r].empty())
+            return false;
+        if (first == count)
+            first = r;
+        else if (level_rows[r].size() != level_rows[first].size())
+            return false;
+        hdr.level_db[levels++] = levels_db[r];
+    }
+    if (levels == 0)
+        return false;
+
+    const unsigned ns = level_rows[first].size() / 3;
+    if (ns > max_points)
+        return false;
+    hdr.num_channels = 1;
+    hdr.num_levels = levels;
+    hdr.num_points = ns;
+
+    struct stat st;
+    if (stat((dir + "/" + names[first] + ".dat").c_str(), &st) == 0)
+        hdr.timestamp = st.st_mtime;
+
+    data.frequency.reset(new double[ns]);
+    data.response.reset(new cfloat[(size_t)levels * ns]);
+    data.coherence.reset(new float[(size_t)levels * ns]);
+    std::fill_n(data.coherence.get(), (size_t)levels * ns, 1.0f);
+    for (unsigned i = 0; i < ns; ++i)
+        data.frequency[i] = level_rows[first][i * 3];
+
+    for (unsigned r = 0, l = 0; r < count; ++r) {
+        const std::vector<double> &rows = level_rows[r];
+        if (rows.empty())
+            continue;
+        cfloat *response = &data.response[(size_t)l++ * ns];
+        for (unsigned i = 0; i < ns; ++i) {
+            if (rows[i * 3] != data.frequency[i])
+                return false;
+            response[i] = std::polar<float>(rows[i * 3 + 1], rows[i * 3 + 2]);
+        }
+    }
+
+    return true;
+}
+
+bool read_dat(const std::string &dir, Data &data)
+{
+    Header &hdr = data.header;
+    init_header(hdr);
+
+    if (!file_exists(dir + "/map.dat") && !file_exists(dir + "/map-ch1.dat"))
+        return read_legacy_dat(dir, data);
+
+    // the channels by their maps, numbered if there are several
+    unsigned channels = 0;
+    if (file_exists(dir + "/map.dat"))
+        channels = 1;
+    else {
+        while (channels < Analysis::channels_max &&
+               file_exists(dir + "/map-ch" + std::to_string(channels + 1) + ".dat"))
+            ++channels;
+        if (channels == 1)
+            return false;
+    }
+    if (channels == 0)
+        return false;
+    hdr.num_channels = channels;
+
+    // the levels, from the first line of the map
+    const std::string map_path = dir + "/map" + channel_suffix(hdr, 0) + ".dat";
+    {
+        std::ifstream file(map_path);
+        std::string line;
+        const char prefix[] = "# levels (dB):";
+        if (!std::getline(file, line) || line.compare(0, sizeof(prefix) - 1, prefix) != 0)
+            return false;
+        std::vector<double> values;
+        parse_line(line.substr(sizeof(prefix) - 1), values);
+        if (values.empty() || values.size() > Analysis::levels_max)
+            return false;
+        hdr.num_levels = values.size();
+        std::copy(values.begin(), values.end(), hdr.level_db);
+    }
+
+    struct stat st;
+    if (stat(map_path.c_str(), &st) == 0)
+        hdr.timestamp = st.st_mtime;
+
+    const unsigned levels = hdr.num_levels;
+    const unsigned map_width = 1 + 2 * levels;
+    std::vector<double> rows;
+
+    unsigned ns = 0;
+    for (unsigned c = 0; c < channels; ++c) {
+        if (!read_rows(dir + "/map" + channel_suffix(hdr, c) + ".dat", map_width, rows))
+            return false;
+        if (c == 0) {
+            ns = rows.size() / map_width;
+            if (ns == 0 || ns > max_points)
+                return false;
+            hdr.num_points = ns;
+            data.frequency.reset(new double[ns]);
+            data.response.reset(new cfloat[column_size(hdr, Column_Response) / sizeof(cfloat)]);
+            for (unsigned i = 0; i < ns; ++i)
+                data.frequency[i] = rows[i * map_width];
+        }
+        else if (rows.size() != (size_t)ns * map_width)
+            return false;
+        for (unsigned l = 0; l < levels; ++l) {
+            cfloat *response = &data.response[((size_t)c * levels + l) * ns];
+            for (unsigned i = 0; i < ns; ++i) {
+                const double *row = &rows[i * map_width + 1 + 2 * l];
+                response[i] = std::polar<float>(row[0], row[1]);
+            }
+        }
+    }
+
+    auto row = [&](unsigned c, unsigned l) -> size_t { return ((size_t)c * levels + l) * ns; };
+    const size_t matrix = (size_t)channels * levels * ns;
+
+    // the coherence, in the files of the levels since it was estimated
+    data.coherence.reset(new float[matrix]);
+    std::fill_n(data.coherence.get(), matrix, 1.0f);
+    for (unsigned c = 0; c < channels; ++c) {
+        for (unsigned l = 0; l < levels; ++l) {
+            if (read_rows(dir + "/" + level_base(hdr, c, l) + ".dat", 4, rows) && rows.size() == (size_t)ns * 4) {
+                for (unsigned i = 0; i < ns; ++i)
+                    data.coherence[row(c, l) + i] = rows[i * 4 + 3];
+            }
+        }
+    }
+
+    // the distortion and the harmonics of the levels which have them
+    const unsigned dist_width = 4 + 2 * Analysis::distortion_num_harmonics;
+    for (unsigned l = 0; l < levels; ++l) {
+        if (!file_exists(dir + "/" + level_base(hdr, 0, l) + "-distortion.dat"))
+            continue;
+        if (!data.distortion) {
+            data.distortion.reset(new cfloat[matrix * Analysis::distortion_num_harmonics]());
+            data.thd.reset(new float[matrix]());
+            data.thdn.reset(new float[matrix]());
+            data.noise.reset(new float[matrix]());
+        }
+        hdr.distortion_mask |= 1u << l;
+        for (unsigned c = 0; c < channels; ++c) {
+            if (!read_rows(dir + "/" + level_base(hdr, c, l) + "-distortion.dat", dist_width, rows) || rows.size() != (size_t)ns * dist_width)
+                return false;
+            for (unsigned i = 0; i < ns; ++i) {
+                const double *line = &rows[i * dist_width];
+                const size_t offset = row(c, l) + i;
+                data.thd[offset] = line[1];
+                data.thdn[offset] = line[2];
+                data.noise[offset] = line[3];
+                for (unsigned h = 0; h < Analysis::distortion_num_harmonics; ++h)
+                    data.distortion[offset * Analysis::distortion_num_harmonics + h] = std::polar<float>(line[4 + 2 * h], line[5 + 2 * h]);
+            }
+        }
+    }
+
+    for (unsigned l = 0; l < levels; ++l) {
+        if (!file_exists(dir + "/" + level_base(hdr, 0, l) + "-h2.dat"))
+            continue;
+        if (!data.harmonics)
+            data.harmonics.reset(new cfloat[matrix * Analysis::ess_num_harmonics]());
+        hdr.harmonics_mask |= 1u << l;
+        for (unsigned c = 0; c < channels; ++c) {
+            for (unsigned h = 0; h < Analysis::ess_num_harmonics; ++h) {
+                const std::string path = dir + "/" + level_base(hdr, c, l) + "-h" + std::to_string(h + 2) + ".dat";
+                if (!read_rows(path, 3, rows) || rows.size() != (size_t)ns * 3)
+                    return false;
+                cfloat *harmonic = &data.harmonics[row(c, l) * Analysis::ess_num_harmonics + h * ns];
+                for (unsigned i = 0; i < ns; ++i)
+                    harmonic[i] = std::polar<float>(rows[i * 3 + 1], rows[i * 3 + 2]);
+            }
+        }
+    }
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+static bool valid_header(const Header &hdr, size_t file_size)
+{
+    if (std::memcmp(hdr.magic, magic, sizeof(magic)) != 0 || hdr.byte_order != byte_order_mark)
+        return false;
+
+    // a later version may grow the header, never change this part of it
+    if (hdr.version != version || hdr.header_size < sizeof(Header) || hdr.header_size > file_size)
+        return false;
+
+    if (hdr.num_channels < 1 || hdr.num_channels > Analysis::channels_max ||
+        hdr.num_levels < 1 || hdr.num_levels > Analysis::levels_max ||
+        hdr.num_points < 1 || hdr.num_points > max_points)
+        return false;
+
+    for (unsigned col = 0; col < Column_Count; ++col) {
+        const Header::Entry &entry = hdr.column[col];
+        if (entry.offset == 0) {
+            if (col == Column_Frequency || col == Column_Response)
+                return false;
+            continue;
+        }
+        if (entry.offset % column_align != 0 || entry.offset < hdr.header_size ||
+            entry.size != column_size(hdr, (Column)col) ||
+            entry.offset > file_size || entry.size > file_size - entry.offset)
+            return false;
+    }
+
+    return true;
+}
+
+}  // namespace Profile
+
+//------------------------------------------------------------------------------
+Profile_File::Profile_File()
+{
+}
+
+Profile_File::~Profile_File()
+{
+    close();
+}
+
+bool Profile_File::open(const std::string &path)
+{
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY|O_CLOEXEC);
+    if (fd == -1)
+        return false;
+
+    struct stat st;
+    void *map = MAP_FAILED;
+    size_t size = 0;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(Profile::Header)) {
+        size = st.st_size;
+        map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    ::close(fd);
+
+    if (map == MAP_FAILED)
+        return false;
+
+    if (!Profile::valid_header(*(const Profile::Header *)map, size)) {
+        munmap(map, size);
+        return false;
+    }
+
+    map_ = map;
+    size_ = size;
+    return true;
+}
+
+void Profile_File::close()
+{
+    if (map_)
+        munmap(map_, size_);
+    map_ = nullptr;
+    size_ = 0;
+}
+
+bool Profile_File::is_open() const
+{
+    return map_ != nullptr;
+}
+
+const Profile::Header &Profile_File::header() const
+{
+    return *(const Profile::Header *)map_;
+}
+
+const void *Profile_File::column(Profile::Column col) const
+{
+    uint64_t offset = header().column[col].offset;
+    return offset ? (const uint8_t *)map_ + offset : nullptr;
+}
+
+void Profile_File::get_columns(const void *columns[Profile::Column_Count]) const
+{
+    for (unsigned col = 0; col < Profile::Column_Count; ++col)
+        columns[col] = column((Profile::Column)col);
+}
+
+size_t Profile_File::row(unsigned channel, unsigned level) const
+{
+    const Profile::Header &hdr = header();
+    return ((size_t)channel * hdr.num_levels + level) * hdr.num_points;
+}
+
+const double *Profile_File::frequency() const
+{
+    return (const double *)column(Profile::Column_Frequency);
+}
+
+const std::complex<float> *Profile_File::response(unsigned channel, unsigned level) const
+{
+    return (const cfloat *)column(Profile::Column_Response) + row(channel, level);
+}
+
+const float *Profile_File::coherence(unsigned channel, unsigned level) const
+{
+    const float *col = (const float *)column(Profile::Column_Coherence);
+    return col ? col + row(channel, level) : nullptr;
+}
+
+const std::complex<float> *Profile_File::harmonic(unsigned channel, unsigned level, unsigned h) const
+{
+    const cfloat *col = (const cfloat *)column(Profile::Column_Harmonics);
+    return col ? col + row(channel, level) * Analysis::ess_num_harmonics + h * header().num_points : nullptr;
+}
+
+const std::complex<float> *Profile_File::distortion(unsigned channel, unsigned level) const
+{
+    const cfloat *col = (const cfloat *)column(Profile::Column_Distortion);
+    return col ? col + row(channel, level) * Analysis::distortion_num_harmonics : nullptr;
+}
+
+const float *Profile_File::thd(unsigned channel, unsigned level) const
+{
+    const float *col = (const float *)column(Profile::Column_Thd);
+    return col ? col + row(channel, level) : nullptr;
+}
+
+const float *Profile_File::thdn(unsigned channel, unsigned level) const
+{
+    const float *col = (const float *)column(Profile::Column_Thdn);
+    return col ? col + row(channel, level) : nullptr;
+}
+
+const float *Profile_File::noise(unsigned channel, unsigned level) const
+{
+    const float *col = (const float *)column(Profile::Column_Noise);
+    return col ? col + row(channel, level) : nullptr;
+}
@@ -0,0 +1,140 @@
+//          Copyright Jean Pierre Cimalando 2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+#include "analyzerdefs.h"
+#include <string>
+#include <memory>
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+
+// Binary profile: a fixed header, then the columns of the measurement, each
+// an array of native values aligned to a cache line, so that a mapped file
+// is used in place. The columns have the layout of the data of the
+// application: a level-by-point matrix per channel, channel by channel; the
+// sweep harmonics have their orders between the level and the point, and
+// the distortion harmonics theirs after the point.
+namespace Profile {
+
+enum { version = 1 };
+enum { column_align = 64 };
+
+enum Column {
+    Column_Frequency, // double, a row of points
+    Column_Response, // complex float
+    Column_Coherence, // float
+    Column_Harmonics, // complex float, ess_num_harmonics orders from H2
+    Column_Distortion, // complex float, distortion_num_harmonics orders from H2
+    Column_Thd, // float
+    Column_Thdn, // float
+    Column_Noise, // float
+    Column_Count,
+};
+
+// entries of the directory, with room for the columns of later versions
+enum { max_columns = 16 };
+
+struct Header {
+    char magic[8];
+    uint32_t byte_order;
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t fft_size;
+    double sample_rate;
+    int32_t mode;
+    int32_t window;
+    uint32_t averages;
+    uint32_t num_channels;
+    uint32_t num_levels;
+    uint32_t num_points;
+    // a bit per level, set if the level has the column measured
+    uint32_t harmonics_mask;
+    uint32_t distortion_mask;
+    double gain;
+    int64_t timestamp; // seconds since the epoch
+    double level_db[Analysis::levels_max];
+    // in bytes from the start of the file, the offset zero if absent
+    struct Entry {
+        uint64_t offset;
+        uint64_t size;
+    } column[max_columns];
+};
+
+// a header of this version, with the rest to be filled
+void init_header(Header &hdr);
+
+// the size in bytes of a column, for the dimensions of the header
+size_t column_size(const Header &hdr, Column col);
+
+// write the binary profile, of the columns which are not null; the entries
+// of the directory are computed
+bool write(const std::string &path, const Header &hdr, const void *const columns[Column_Count]);
+
+// the text layout of a profile directory: the level-by-frequency map per
+// channel, and per level the response, the distortion and the harmonics
+bool write_dat(const std::string &dir, const Header &hdr, const void *const columns[Column_Count]);
+
+// the text of a filter fitted to the response of a channel at a level,
+// beside its files: a line of the numerator, then one of the denominator
+bool write_filter(const std::string &dir, const Header &hdr, unsigned channel, unsigned level,
+                  const double *b, unsigned nb, const double *a, unsigned na);
+
+// a profile read from its text layout, with the header filled with what
+// the text holds, the rest zero; a directory without a map is read as the
+// "lo.dat" and "hi.dat" of the first versions, levels of -40 and 0 dB
+struct Data {
+    Header header;
+    std::unique_ptr<double[]> frequency;
+    std::unique_ptr<std::complex<float>[]> response;
+    std::unique_ptr<float[]> coherence;
+    std::unique_ptr<std::complex<float>[]> harmonics;
+    std::unique_ptr<std::complex<float>[]> distortion;
+    std::unique_ptr<float[]> thd;
+    std::unique_ptr<float[]> thdn;
+    std::unique_ptr<float[]> noise;
+    void get_columns(const void *columns[Column_Count]) const;
+};
+
+bool read_dat(const std::string &dir, Data &data);
+
+}  // namespace Profile
+
+// A binary profile mapped in memory, validated when opened, with the
+// columns read in place.
+class Profile_File {
+public:
+    Profile_File();
+    ~Profile_File();
+
+    Profile_File(const Profile_File &) = delete;
+    Profile_File &operator=(const Profile_File &) = delete;
+
+    bool open(const std::string &path);
+    void close();
+    bool is_open() const;
+
+    const Profile::Header &header() const;
+
+    // null if absent
+    const void *column(Profile::Column col) const;
+    void get_columns(const void *columns[Profile::Column_Count]) const;
+
+    const double *frequency() const;
+    const std::complex<float> *response(unsigned channel, unsigned level) const;
+    const float *coherence(unsigned channel, unsigned level) const;
+    const std::complex<float> *harmonic(unsigned channel, unsigned level, unsigned h) const;
+    const std::complex<float> *distortion(unsigned channel, unsigned level) const;
+    const float *thd(unsigned channel, unsigned level) const;
+    const float *thdn(unsigned channel, unsigned level) const;
+    const float *noise(unsigned channel, unsigned level) const;
+
+private:
+    size_t row(unsigned channel, unsigned level) const;
+
+private:
+    void *map_ = nullptr;
+    size_t size_ = 0;
+};
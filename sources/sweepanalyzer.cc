@@ -0,0 +1,170 @@
+//          Copyright Jean Pierre Cimalando 2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "sweepanalyzer.h"
+#include "utility/nextpow2.h"
+#include <algorithm>
+#include <new>
+#include <cstdint>
+#include <cmath>
+typedef std::complex<float> cfloat;
+typedef std::complex<double> cdouble;
+
+Sweep_Analyzer::Sweep_Analyzer(float sample_rate, float f1, float f2, float duration, unsigned tail)
+{
+    const unsigned ns = std::lround(duration * sample_rate);
+    const double rate = ns / std::log(f2 / f1);
+    const unsigned fft_size = nextpow2(2 * ns + tail);
+
+    sample_rate_ = sample_rate;
+    length_ = ns;
+    tail_ = tail;
+    rate_ = rate;
+    fft_size_ = fft_size;
+
+    float *signal = new float[ns];
+    signal_.reset(signal);
+
+    // sweep, with short raised-cosine fades against the edge ripple
+    const unsigned fade_in = ns / 50;
+    const unsigned fade_out = ns / 200;
+    for (unsigned i = 0; i < ns; ++i) {
+        double w = 1;
+        if (i < fade_in)
+            w = 0.5 * (1 - std::cos(M_PI * i / fade_in));
+        else if (i >= ns - fade_out)
+            w = 0.5 * (1 - std::cos(M_PI * (ns - 1 - i) / fade_out));
+        signal[i] = w * std::sin(2 * M_PI * f1 / sample_rate * rate * (std::exp(i / rate) - 1));
+    }
+
+    real_.reset(fftwf_alloc_real(fft_size));
+    cplx_.reset((cfloat *)fftwf_alloc_complex(fft_size / 2 + 1));
+    inverse_.reset((cfloat *)fftwf_alloc_complex(fft_size / 2 + 1));
+    if (!real_ || !cplx_ || !inverse_)
+        throw std::bad_alloc();
+
+    float *real = real_.get();
+    cfloat *cplx = cplx_.get();
+    cfloat *inverse = inverse_.get();
+
+    plan_forward_.reset(fftwf_plan_dft_r2c_1d(fft_size, real, (fftwf_complex *)cplx, FFTW_ESTIMATE));
+    plan_backward_.reset(fftwf_plan_dft_c2r_1d(fft_size, (fftwf_complex *)cplx, real, FFTW_ESTIMATE));
+    if (!plan_forward_ || !plan_backward_)
+        throw std::bad_alloc();
+
+    // inverse filter, by regularized spectral inversion (Kirkeby): inside
+    // the band it is the time-reversed and enveloped sweep of Farina, minus
+    // the ripple which the sweep edges cause at the extremes, and it fades
+    // out with the sweep spectrum outside the band
+    std::fill_n(real, fft_size, 0);
+    std::copy_n(signal, ns, real);
+    fftwf_execute(plan_forward_.get());
+
+    double power_max = 0;
+    for (unsigned k = 0; k < fft_size / 2 + 1; ++k)
+        power_max = std::max(power_max, (double)std::norm(cplx[k]));
+
+    const double beta = 1e-8 * power_max;
+    for (unsigned k = 0; k < fft_size / 2 + 1; ++k) {
+        double power = std::norm(cplx[k]);
+        inverse[k] = std::conj(cplx[k]) * (float)(1 / ((power + beta) * fft_size));
+    }
+
+    // center the response on the end of the sweep, like the time-reversed
+    // filter does, so the harmonics fall in the first half
+    for (unsigned k = 0; k < fft_size / 2 + 1; ++k) {
+        unsigned m = (uint64_t)k * (ns - 1) % fft_size;
+        inverse[k] *= (cfloat)std::polar(1.0, -2 * M_PI * m / fft_size);
+    }
+}
+
+Sweep_Analyzer::~Sweep_Analyzer()
+{
+}
+
+const float *Sweep_Analyzer::signal() const
+{
+    return signal_.get();
+}
+
+unsigned Sweep_Analyzer::signal_length() const
+{
+    return length_;
+}
+
+unsigned Sweep_Analyzer::capture_length() const
+{
+    return length_ + tail_;
+}
+
+void Sweep_Analyzer::analyze(
+    const float *capture, float amplitude,
+    const float *freqs, unsigned count, cfloat *response,
+    cfloat *const *harmonics, unsigned num_harmonics)
+{
+    const unsigned fft_size = fft_size_;
+    const unsigned len = capture_length();
+    float *real = real_.get();
+    cfloat *cplx = cplx_.get();
+    const cfloat *inverse = inverse_.get();
+
+    std::copy_n(capture, len, real);
+    std::fill(real + len, real + fft_size, 0);
+    fftwf_execute(plan_forward_.get());
+
+    for (unsigned k = 0; k < fft_size / 2 + 1; ++k)
+        cplx[k] *= inverse[k] / amplitude;
+    fftwf_execute(plan_backward_.get());
+
+    const double rate = rate_;
+    const unsigned origin = length_ - 1;
+    const double nyquist = 0.5 * sample_rate_;
+
+    // linear response, up to midway to the second harmonic
+    unsigned lin_begin = origin - (unsigned)(0.5 * rate * std::log(2.0));
+    unsigned lin_end = origin + tail_;
+    for (unsigned i = 0; i < count; ++i)
+        response[i] = evaluate(origin, lin_begin, lin_end, freqs[i]);
+
+    // harmonic responses, each between midpoints to its neighbors
+    for (unsigned h = 0; h < num_harmonics; ++h) {
+        const unsigned k = h + 2;
+        double center = origin - rate * std::log((double)k);
+        unsigned begin = std::lround(center - 0.5 * rate * std::log((k + 1.0) / k));
+        unsigned end = std::lround(center + 0.5 * rate * std::log(k / (k - 1.0)));
+        for (unsigned i = 0; i < count; ++i) {
+            double f = k * (double)freqs[i];
+            harmonics[h][i] = (f < nyquist) ? (cfloat)evaluate(center, begin, end, f) : cfloat();
+        }
+    }
+}
+
+cdouble Sweep_Analyzer::evaluate(double center, unsigned begin, unsigned end, double freq) const
+{
+    // DFT of the section at one frequency, time-referenced to `center`,
+    // with raised-cosine tapers over the first half of the part before the
+    // center and the last quarter of the part after it
+    const float *ir = real_.get();
+    const double w = 2 * M_PI * freq / sample_rate_;
+    const cdouble rot = std::polar(1.0, -w);
+    cdouble osc = std::polar(1.0, -w * (begin - center));
+
+    const unsigned len = end - begin;
+    const unsigned fade_in = std::max(1u, (unsigned)((center - begin) / 2));
+    const unsigned fade_out = std::max(1u, (unsigned)((end - center) / 4));
+    cdouble sum = 0;
+
+    for (unsigned i = 0; i < len; ++i) {
+        double g = 1;
+        if (i < fade_in)
+            g = 0.5 * (1 - std::cos(M_PI * i / fade_in));
+        else if (i >= len - fade_out)
+            g = 0.5 * (1 - std::cos(M_PI * (len - 1 - i) / fade_out));
+        sum += (g * ir[begin + i]) * osc;
+        osc *= rot;
+    }
+
+    return sum;
+}
@@ -0,0 +1,47 @@
+//          Copyright Jean Pierre Cimalando 2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+#include "utility/fftw_memory.h"
+#include <memory>
+#include <complex>
+
+// Exponential sine sweep measurement, after A. Farina (2000).
+// The capture is deconvolved with the inverse filter of the sweep, which
+// places the linear impulse response at the end of the sweep and the
+// impulse response of each harmonic order k at L·ln(k) samples before it.
+class Sweep_Analyzer {
+public:
+    Sweep_Analyzer(float sample_rate, float f1, float f2, float duration, unsigned tail);
+    ~Sweep_Analyzer();
+
+    const float *signal() const;
+    unsigned signal_length() const;
+    unsigned capture_length() const;
+
+    // compute the linear response, and the responses of the harmonics 2 to
+    // num_harmonics+1 each taken at the output frequency k·f
+    void analyze(
+        const float *capture, float amplitude,
+        const float *freqs, unsigned count, std::complex<float> *response,
+        std::complex<float> *const *harmonics, unsigned num_harmonics);
+
+private:
+    std::complex<double> evaluate(double center, unsigned begin, unsigned end, double freq) const;
+
+private:
+    float sample_rate_ = 0;
+    unsigned length_ = 0;
+    unsigned tail_ = 0;
+    double rate_ = 0;
+    unsigned fft_size_ = 0;
+
+    std::unique_ptr<float[]> signal_;
+    std::unique_ptr<float[], Fftwf_Deleter> real_;
+    std::unique_ptr<std::complex<float>[], Fftwf_Deleter> cplx_;
+    std::unique_ptr<std::complex<float>[], Fftwf_Deleter> inverse_;
+    std::unique_ptr<fftwf_plan_s, Fftwf_Plan_Deleter> plan_forward_;
+    std::unique_ptr<fftwf_plan_s, Fftwf_Plan_Deleter> plan_backward_;
+};
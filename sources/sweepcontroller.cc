@@ -0,0 +1,1058 @@
+//          Copyright Jean Pierre Cimalando 2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "sweepcontroller.h"
+#include "audioprocessor.h"
+#include "analyzerdefs.h"
+#include "messages.h"
+#include "filterfit.h"
+#include "utility/counting_bitset.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QSocketNotifier>
+#include <QTimer>
+#include <algorithm>
+#include <vector>
+#include <complex>
+#include <limits>
+#include <cmath>
+#include <cassert>
+typedef std::complex<float> cfloat;
+typedef std::complex<double> cdouble;
+
+struct SweepController::Impl {
+    SweepController *self_ = nullptr;
+    Audio_Processor *proc_ = nullptr;
+    QTimer *tm_nextsweep_ = nullptr;
+    QSocketNotifier *sn_notifications_ = nullptr;
+
+    // the responses, plots, harmonics and distortions are level-by-frequency
+    // matrices, one per channel, laid out channel by channel; the harmonics
+    // have their orders in between the level and the frequency, and the
+    // distortion harmonics theirs after the frequency
+    unsigned channels_ = 1;
+    unsigned levels_ = 2;
+
+    // the amplitudes of the drive levels, in increasing order, and the gain
+    // of the output; sent with each request, never shared with the processor
+    float level_amplitude_[Analysis::levels_max] = {0.01f, 1.0f};
+    float output_gain_ = Analysis::output_gain_default;
+
+    std::unique_ptr<double[]> an_freqs_;
+    std::unique_ptr<cfloat[]> an_response_;
+    std::unique_ptr<float[]> an_coherence_;
+    std::unique_ptr<double[]> an_plot_mags_;
+    std::unique_ptr<double[]> an_plot_phases_;
+    std::unique_ptr<cfloat[]> an_harmonics_;
+    std::unique_ptr<bool[]> an_has_harmonics_;
+    std::unique_ptr<cfloat[]> an_distortion_;
+    std::unique_ptr<float[]> an_thd_;
+    std::unique_ptr<float[]> an_thdn_;
+    std::unique_ptr<float[]> an_noise_;
+    std::unique_ptr<double[]> an_plot_thd_;
+    std::unique_ptr<double[]> an_plot_thdn_;
+    std::unique_ptr<bool[]> an_has_distortion_;
+
+    // the measurements of each point since the start of the sweep, of which
+    // the response is the mean
+    std::unique_ptr<unsigned[]> an_count_;
+    std::unique_ptr<cdouble[]> an_sum_;
+    std::unique_ptr<double[]> an_sum_power_;
+
+    // saved profiles, mapped or read from their text; the difference to the
+    // first, NaN where there is none, is of the measured points and its
+    // reference interpolated at their frequencies
+    struct Reference {
+        Profile_File file;
+        Profile::Data data;
+        const Profile::Header *header = nullptr;
+        const void *columns[Profile::Column_Count] = {};
+    };
+    std::vector<std::unique_ptr<Reference>> references_;
+    std::unique_ptr<double[]> an_plot_diff_mags_;
+    std::unique_ptr<double[]> an_plot_diff_phases_;
+
+    // the filters fitted to the responses, a numerator and a denominator
+    // per channel and level, empty where too little is measured, and the
+    // matrices of their gains, NaN where there is none
+    unsigned filter_zeros_ = Analysis::filter_order_default;
+    unsigned filter_poles_ = Analysis::filter_order_default;
+    unsigned filter_iterations_ = Analysis::filter_iterations_default;
+    std::unique_ptr<Filter_Fitter> fitter_;
+    struct Filter {
+        std::vector<double> b, a;
+        double error = 0;
+    };
+    std::vector<Filter> filters_;
+    std::unique_ptr<double[]> an_plot_filter_;
+
+    // the sweep goes through all levels at each step, and the steps in turn;
+    // the stepped sweep is walked by the processor, from a plan which is
+    // sent again when the settings change
+    bool sweep_active_ = false;
+    unsigned sweep_index_ = 0;
+    // of the latest request or stop, which the notifications must match
+    unsigned serial_ = 0;
+    int sweep_spl_ = 0;
+    unsigned freqs_at_once_ = 1;
+    int window_ = Analysis::Window_Hann;
+    unsigned averages_ = 1;
+    double confidence_ = 0;
+    unsigned max_repeats_ = Analysis::repeats_default;
+    int mode_ = Analysis::Mode_Stepped;
+    unsigned sweep_length_ = 0;
+    counting_bitset sweep_progress_;
+
+    float amplitude(int spl) const;
+    void set_sweep_phase(int spl);
+    void allocate(unsigned ns);
+    unsigned row(unsigned channel, int spl) const;
+    void store_response(int spl, unsigned channel, unsigned index, cfloat response, float coherence = 1);
+    bool confident(int spl, unsigned index) const;
+    void reset_progress();
+    void start_pass();
+    int reference_level(const Reference &ref, int spl) const;
+    void update_difference(int spl, unsigned channel, unsigned index);
+    void update_differences();
+    void fit_filters();
+    void store_distortion(int spl, unsigned channel, unsigned index, const cfloat *harmonics, float thd, float thdn, float noise);
+    void update_progress(int spl, unsigned index);
+    void finish_step(int next_spl, unsigned next_index);
+    void restart_plan();
+};
+
+SweepController::SweepController(Audio_Processor &proc, QObject *parent)
+    : QObject(parent), P(new Impl)
+{
+    P->self_ = this;
+    P->proc_ = &proc;
+    P->channels_ = proc.num_channels();
+
+    QTimer *tm = P->tm_nextsweep_ = new QTimer(this);
+    tm->setSingleShot(true);
+    connect(tm, &QTimer::timeout, this, &SweepController::nextSweepTick);
+
+    // the notifications are handled as soon as they are posted
+    QSocketNotifier *sn = P->sn_notifications_ = new QSocketNotifier(proc.notification_fd(), QSocketNotifier::Read, this);
+    connect(sn, &QSocketNotifier::activated, this, &SweepController::receiveNotifications);
+
+    P->allocate(Analysis::sweep_length_default);
+}
+
+SweepController::~SweepController()
+{
+}
+
+void SweepController::setDriveLevels(const double *levels, unsigned count)
+{
+    count = std::min<unsigned>(count, Analysis::levels_max);
+    if (count == 0)
+        return;
+
+    // in increasing order, the first being the level of the calibration
+    std::vector<double> sorted(levels, levels + count);
+    std::sort(sorted.begin(), sorted.end());
+    for (unsigned l = 0; l < count; ++l) {
+        double db = std::max<double>(sorted[l], Analysis::level_db_min);
+        P->level_amplitude_[l] = std::pow(10.0, db * 0.05);
+    }
+
+    P->levels_ = count;
+    P->allocate(P->sweep_length_);
+    P->sweep_index_ = 0;
+    P->set_sweep_phase(0);
+    emit driveLevelsChanged();
+    emit progressChanged(0);
+    emit responsesChanged();
+    P->restart_plan();
+}
+
+unsigned SweepController::numLevels() const
+{
+    return P->levels_;
+}
+
+double SweepController::driveLevel(unsigned index) const
+{
+    return 20 * std::log10((index < P->levels_) ? P->level_amplitude_[index] : 0.0);
+}
+
+void SweepController::setOutputGain(double gain)
+{
+    if (P->output_gain_ == (float)gain)
+        return;
+
+    P->output_gain_ = gain;
+    P->restart_plan();
+}
+
+double SweepController::outputGain() const
+{
+    return P->output_gain_;
+}
+
+void SweepController::setSweepLength(unsigned count)
+{
+    count = std::max<unsigned>(count, Analysis::sweep_length_min);
+    count = std::min<unsigned>(count, Analysis::sweep_length_max);
+    if (count == P->sweep_length_)
+        return;
+
+    P->allocate(count);
+    P->sweep_index_ = 0;
+    P->freqs_at_once_ = std::min(P->freqs_at_once_, count);
+    emit progressChanged(0);
+    emit responsesChanged();
+    P->restart_plan();
+}
+
+unsigned SweepController::sweepLength() const
+{
+    return P->sweep_length_;
+}
+
+void SweepController::setFreqsAtOnce(unsigned count)
+{
+    P->freqs_at_once_ = count;
+    P->restart_plan();
+}
+
+void SweepController::setWindowFunction(int window)
+{
+    P->window_ = window;
+    P->restart_plan();
+}
+
+void SweepController::setAverages(unsigned count)
+{
+    P->averages_ = std::max(1u, std::min<unsigned>(count, Analysis::averages_max));
+    P->restart_plan();
+}
+
+void SweepController::setConfidence(double width)
+{
+    P->confidence_ = std::max(0.0, std::min<double>(width, Analysis::confidence_db_max));
+}
+
+void SweepController::setMaxRepeats(unsigned count)
+{
+    P->max_repeats_ = std::max<unsigned>(Analysis::repeats_min, std::min<unsigned>(count, Analysis::repeats_max));
+}
+
+void SweepController::setMeasurementMode(int mode)
+{
+    if (P->mode_ == mode)
+        return;
+
+    // a plan runs until replaced, other measurements until they complete
+    const bool stepped = P->mode_ == Analysis::Mode_Stepped;
+    P->mode_ = mode;
+    if (P->sweep_active_ && stepped)
+        nextSweepTick();
+}
+
+void SweepController::setSettleMargin(double margin)
+{
+    P->proc_->set_settle_margin(margin);
+}
+
+void SweepController::setCrossfade(bool enable)
+{
+    P->proc_->set_crossfade(enable);
+}
+
+unsigned SweepController::numChannels() const
+{
+    return P->channels_;
+}
+
+void SweepController::setFilterOrder(unsigned zeros, unsigned poles)
+{
+    P->filter_zeros_ = std::min<unsigned>(zeros, Analysis::filter_order_max);
+    P->filter_poles_ = std::min<unsigned>(poles, Analysis::filter_order_max);
+}
+
+void SweepController::setFilterIterations(unsigned count)
+{
+    P->filter_iterations_ = std::min<unsigned>(count, Analysis::filter_iterations_max);
+}
+
+bool SweepController::setEmulation(int mode, unsigned level)
+{
+    const unsigned channels = P->channels_;
+    const unsigned levels = P->levels_;
+    const int timeout = 1000;
+    bool ok = level < levels;
+
+    switch (ok ? mode : Analysis::Emulation_Live) {
+    case Analysis::Emulation_Fir: {
+        const unsigned length = Analysis::emulation_fir_length;
+        Filter_Fitter fitter(length);
+        std::unique_ptr<float[]> ir(new float[channels * length]);
+        std::unique_ptr<const float *[]> irs(new const float *[channels]);
+        for (unsigned c = 0; ok && c < channels; ++c) {
+            ok = fitter.set_response(P->an_freqs_.get(), &P->an_response_[P->row(c, level)], P->sweep_length_, Analysis::sample_rate);
+            std::copy_n(fitter.impulse_response(), length, &ir[c * length]);
+            irs[c] = &ir[c * length];
+        }
+        ok = ok && P->proc_->set_emulation_fir(irs.get(), length, timeout);
+        break;
+    }
+    case Analysis::Emulation_Iir: {
+        fitFilters();
+        std::unique_ptr<const double *[]> b(new const double *[channels]);
+        std::unique_ptr<const double *[]> a(new const double *[channels]);
+        for (unsigned c = 0; ok && c < channels; ++c) {
+            const Impl::Filter &filter = P->filters_[c * levels + level];
+            ok = !filter.b.empty();
+            b[c] = filter.b.data();
+            a[c] = filter.a.data();
+        }
+        ok = ok && P->proc_->set_emulation_iir(b.get(), P->filter_zeros_ + 1, a.get(), P->filter_poles_ + 1, timeout);
+        break;
+    }
+    default:
+        P->proc_->set_emulation_live(timeout);
+        break;
+    }
+
+    if (!ok)
+        P->proc_->set_emulation_live(timeout);
+    return ok;
+}
+
+bool SweepController::sweepActive() const
+{
+    return P->sweep_active_;
+}
+
+void SweepController::setSweepActive(bool active)
+{
+    if (P->sweep_active_ == active)
+        return;
+
+    P->sweep_active_ = active;
+    if (!active) {
+        P->tm_nextsweep_->stop();
+
+        Messages::RequestStop msg;
+        ++P->serial_;
+        P->proc_->send_message(msg);
+    }
+    else {
+        P->reset_progress();
+        emit progressChanged(0);
+        P->tm_nextsweep_->start(0);
+    }
+}
+
+void SweepController::measureLatency()
+{
+    Messages::RequestMeasureLatency msg;
+    msg.serial = ++P->serial_;
+    msg.spl = 0;
+    msg.amplitude = P->amplitude(0);
+    P->proc_->send_message(msg);
+}
+
+void SweepController::fitFilters()
+{
+    P->fit_filters();
+    emit responsesChanged();
+}
+
+bool SweepController::saveProfile(const QString &dirname)
+{
+    QDir(dirname).mkpath(".");
+
+    const unsigned channels = P->channels_;
+    const unsigned levels = P->levels_;
+
+    Profile::Header hdr;
+    Profile::init_header(hdr);
+    hdr.fft_size = P->proc_->fft_size();
+    hdr.sample_rate = Analysis::sample_rate;
+    hdr.mode = P->mode_;
+    hdr.window = P->window_;
+    hdr.averages = P->averages_;
+    hdr.num_channels = channels;
+    hdr.num_levels = levels;
+    hdr.num_points = P->sweep_length_;
+    for (unsigned l = 0; l < levels; ++l) {
+        hdr.level_db[l] = driveLevel(l);
+        hdr.harmonics_mask |= (unsigned)P->an_has_harmonics_[l] << l;
+        hdr.distortion_mask |= (unsigned)P->an_has_distortion_[l] << l;
+    }
+    hdr.gain = P->output_gain_;
+    hdr.timestamp = QDateTime::currentMSecsSinceEpoch() / 1000;
+
+    const void *columns[Profile::Column_Count];
+    columns[Profile::Column_Frequency] = P->an_freqs_.get();
+    columns[Profile::Column_Response] = P->an_response_.get();
+    columns[Profile::Column_Coherence] = P->an_coherence_.get();
+    columns[Profile::Column_Harmonics] = hdr.harmonics_mask ? P->an_harmonics_.get() : nullptr;
+    columns[Profile::Column_Distortion] = hdr.distortion_mask ? P->an_distortion_.get() : nullptr;
+    columns[Profile::Column_Thd] = hdr.distortion_mask ? P->an_thd_.get() : nullptr;
+    columns[Profile::Column_Thdn] = hdr.distortion_mask ? P->an_thdn_.get() : nullptr;
+    columns[Profile::Column_Noise] = hdr.distortion_mask ? P->an_noise_.get() : nullptr;
+
+    const std::string dir = dirname.toLocal8Bit().data();
+    bool ok = Profile::write(dir + "/profile.bin", hdr, columns) && Profile::write_dat(dir, hdr, columns);
+
+    P->fit_filters();
+    for (unsigned c = 0; ok && c < channels; ++c) {
+        for (unsigned l = 0; ok && l < levels; ++l) {
+            const Impl::Filter &filter = P->filters_[c * levels + l];
+            if (!filter.b.empty())
+                ok = Profile::write_filter(dir, hdr, c, l, filter.b.data(), filter.b.size(), filter.a.data(), filter.a.size());
+        }
+    }
+    emit responsesChanged();
+
+    return ok;
+}
+
+bool SweepController::addReference(const QString &filename)
+{
+    QFileInfo info(filename);
+    std::unique_ptr<Impl::Reference> ref(new Impl::Reference);
+
+    // the binary profile in place, or else the text files around it
+    bool ok;
+    if (info.suffix() == "bin") {
+        ok = ref->file.open(filename.toLocal8Bit().data());
+        if (ok) {
+            ref->header = &ref->file.header();
+            ref->file.get_columns(ref->columns);
+        }
+    }
+    else {
+        ok = Profile::read_dat(info.absolutePath().toLocal8Bit().data(), ref->data);
+        if (ok) {
+            ref->header = &ref->data.header;
+            ref->data.get_columns(ref->columns);
+        }
+    }
+
+    if (!ok)
+        return false;
+
+    P->references_.push_back(std::move(ref));
+    P->update_differences();
+    emit responsesChanged();
+    return true;
+}
+
+void SweepController::clearReferences()
+{
+    P->references_.clear();
+    P->update_differences();
+    emit responsesChanged();
+}
+
+unsigned SweepController::numReferences() const
+{
+    return P->references_.size();
+}
+
+const Profile::Header &SweepController::referenceHeader(unsigned index) const
+{
+    return *P->references_[index]->header;
+}
+
+const void *const *SweepController::referenceColumns(unsigned index) const
+{
+    return P->references_[index]->columns;
+}
+
+const double *SweepController::frequencies() const
+{
+    return P->an_freqs_.get();
+}
+
+unsigned SweepController::sweepIndex() const
+{
+    return P->sweep_index_;
+}
+
+const double *SweepController::plotMagnitudes(unsigned channel) const
+{
+    return &P->an_plot_mags_[P->row(channel, 0)];
+}
+
+const double *SweepController::plotPhases(unsigned channel) const
+{
+    return &P->an_plot_phases_[P->row(channel, 0)];
+}
+
+const double *SweepController::plotThd(unsigned channel) const
+{
+    return &P->an_plot_thd_[P->row(channel, 0)];
+}
+
+const double *SweepController::plotThdn(unsigned channel) const
+{
+    return &P->an_plot_thdn_[P->row(channel, 0)];
+}
+
+const float *SweepController::coherence(unsigned channel) const
+{
+    return &P->an_coherence_[P->row(channel, 0)];
+}
+
+const double *SweepController::plotFilter(unsigned channel) const
+{
+    return &P->an_plot_filter_[P->row(channel, 0)];
+}
+
+const double *SweepController::plotDifferenceMagnitudes(unsigned channel) const
+{
+    return &P->an_plot_diff_mags_[P->row(channel, 0)];
+}
+
+const double *SweepController::plotDifferencePhases(unsigned channel) const
+{
+    return &P->an_plot_diff_phases_[P->row(channel, 0)];
+}
+
+double SweepController::deviation() const
+{
+    double deviation = std::numeric_limits<double>::quiet_NaN();
+    for (unsigned i = 0, size = P->channels_ * P->levels_ * P->sweep_length_; i < size; ++i) {
+        double diff = std::abs(P->an_plot_diff_mags_[i]);
+        if (!std::isnan(diff) && !(diff <= deviation))
+            deviation = diff;
+    }
+    return deviation;
+}
+
+double SweepController::filterError(unsigned channel) const
+{
+    double error = std::numeric_limits<double>::quiet_NaN();
+    for (unsigned l = 0, levels = P->filters_.empty() ? 0 : P->levels_; l < levels; ++l) {
+        const Impl::Filter &filter = P->filters_[channel * levels + l];
+        if (!filter.b.empty() && !(filter.error <= error))
+            error = filter.error;
+    }
+    return error;
+}
+
+void SweepController::receiveNotifications()
+{
+    Audio_Processor &proc = *P->proc_;
+
+    while (Basic_Message *hmsg = proc.receive_message()) {
+        switch (hmsg->tag) {
+        case Message_Tag::NotifyFrequencyAnalysis: {
+            auto *msg = (Messages::NotifyFrequencyAnalysis *)hmsg;
+
+            // of a request which has been replaced, or stopped
+            if (msg->serial != P->serial_)
+                break;
+
+            int spl = msg->spl;
+            if (spl == -1)
+                return;
+
+            if ((unsigned)spl >= P->levels_)
+                return;
+
+            // from a plan of another length
+            unsigned index = msg->index;
+            if (index >= P->sweep_length_)
+                return;
+
+            P->start_pass();
+            unsigned done_bins = msg->num_bins;
+            unsigned channels = std::min(msg->num_channels, P->channels_);
+            const float *frequency = msg->frequency();
+            for (unsigned c = 0; c < channels; ++c) {
+                const cfloat *response = msg->response(c);
+                const float *coherence = msg->coherence(c);
+                for (unsigned a = 0; a < done_bins; ++a)  {
+                    unsigned dst_index = Analysis::nth_bin_position(index, a, done_bins, P->sweep_length_);
+                    P->store_response(spl, c, dst_index, response[a], coherence[a]);
+                }
+            }
+
+            // the points which are not yet confident have the step at this
+            // level measured again, ahead of the rest of the plan
+            bool repeat = false;
+            for (unsigned a = 0; a < done_bins; ++a) {
+                unsigned dst_index = Analysis::nth_bin_position(index, a, done_bins, P->sweep_length_);
+                if (P->confident(spl, dst_index))
+                    P->sweep_progress_.set(spl * P->sweep_length_ + dst_index);
+                else
+                    repeat = true;
+            }
+
+            if (repeat && P->sweep_active_) {
+                Messages::RequestRepeatStep req;
+                req.serial = P->serial_;
+                req.spl = spl;
+                req.index = index;
+                proc.send_message(req);
+            }
+
+            emit currentFrequencyChanged(frequency[0]);
+            P->update_progress(spl, index);
+            break;
+        }
+        case Message_Tag::NotifySweepAnalysis: {
+            auto *msg = (Messages::NotifySweepAnalysis *)hmsg;
+            if (msg->serial != P->serial_)
+                break;
+
+            int spl = msg->spl;
+            if (spl == -1)
+                return;
+
+            if ((unsigned)spl >= P->levels_)
+                return;
+            P->an_has_harmonics_[spl] = true;
+            P->start_pass();
+
+            const unsigned ns = P->sweep_length_;
+            unsigned num_points = std::min(msg->num_points, ns);
+            unsigned channels = std::min(msg->num_channels, P->channels_);
+            for (unsigned i = 0; i < num_points; ++i)
+                P->sweep_progress_.set(spl * ns + i);
+            for (unsigned c = 0; c < channels; ++c) {
+                const cfloat *response = msg->response(c);
+                for (unsigned i = 0; i < num_points; ++i) {
+                    P->store_response(spl, c, i, response[i]);
+                    cfloat *harmonics = &P->an_harmonics_[P->row(c, spl) * Analysis::ess_num_harmonics];
+                    for (unsigned h = 0; h < Analysis::ess_num_harmonics; ++h)
+                        harmonics[h * ns + i] = msg->harmonic(c, h)[i];
+                }
+            }
+
+            P->finish_step((spl + 1) % P->levels_, P->sweep_index_);
+            break;
+        }
+        case Message_Tag::NotifyDistortion: {
+            auto *msg = (Messages::NotifyDistortion *)hmsg;
+            if (msg->serial != P->serial_)
+                break;
+
+            // ahead of the response of the same step
+            int spl = msg->spl;
+            if (spl == -1)
+                return;
+
+            if ((unsigned)spl >= P->levels_)
+                return;
+            P->an_has_distortion_[spl] = true;
+
+            unsigned index = msg->index;
+            if (index >= P->sweep_length_)
+                return;
+
+            unsigned done_bins = msg->num_bins;
+            unsigned channels = std::min(msg->num_channels, P->channels_);
+            for (unsigned c = 0; c < channels; ++c) {
+                for (unsigned a = 0; a < done_bins; ++a) {
+                    unsigned dst_index = Analysis::nth_bin_position(index, a, done_bins, P->sweep_length_);
+                    P->store_distortion(spl, c, dst_index, msg->harmonic(c, a), msg->thd(c)[a], msg->thdn(c)[a], msg->noise(c)[a]);
+                }
+            }
+            break;
+        }
+        case Message_Tag::NotifyLatency: {
+            auto *msg = (Messages::NotifyLatency *)hmsg;
+            if (msg->serial != P->serial_)
+                break;
+
+            // stopped ahead of the notification, which may start the sweep,
+            // and the measurements which follow this one are dropped
+            Messages::RequestStop stop;
+            ++P->serial_;
+            proc.send_message(stop);
+
+            // the processor has not retained an invalid measurement
+            emit latencyMeasured(msg->valid ? (int)msg->latency : -1);
+            break;
+        }
+        case Message_Tag::NotifyMlsAnalysis: {
+            auto *msg = (Messages::NotifyMlsAnalysis *)hmsg;
+            if (msg->serial != P->serial_)
+                break;
+
+            int spl = msg->spl;
+            if (spl == -1)
+                return;
+
+            if ((unsigned)spl >= P->levels_)
+                return;
+
+            P->start_pass();
+            unsigned num_points = std::min(msg->num_points, P->sweep_length_);
+            unsigned channels = std::min(msg->num_channels, P->channels_);
+            for (unsigned i = 0; i < num_points; ++i)
+                P->sweep_progress_.set(spl * P->sweep_length_ + i);
+            for (unsigned c = 0; c < channels; ++c) {
+                const cfloat *response = msg->response(c);
+                for (unsigned i = 0; i < num_points; ++i)
+                    P->store_response(spl, c, i, response[i]);
+            }
+
+            P->finish_step((spl + 1) % P->levels_, P->sweep_index_);
+            break;
+        }
+        default:
+            assert(false);
+            break;
+        }
+    }
+}
+
+void SweepController::nextSweepTick()
+{
+    Audio_Processor &proc = *P->proc_;
+    unsigned index = P->sweep_index_;
+
+    if (P->mode_ == Analysis::Mode_Sweep) {
+        const unsigned num_points = P->sweep_length_;
+        auto msg = Messages::create<Messages::RequestAnalyzeSweep>(num_points);
+        msg->serial = ++P->serial_;
+        msg->spl = P->sweep_spl_;
+        msg->amplitude = P->amplitude(P->sweep_spl_);
+        msg->num_points = num_points;
+        float *frequency = msg->frequency();
+        for (unsigned i = 0; i < num_points; ++i)
+            frequency[i] = P->an_freqs_[i];
+        proc.send_message(*msg);
+
+        emit currentFrequencyChanged(frequency[0]);
+        return;
+    }
+
+    if (P->mode_ == Analysis::Mode_Mls) {
+        const unsigned num_points = P->sweep_length_;
+        auto msg = Messages::create<Messages::RequestAnalyzeMls>(num_points);
+        msg->serial = ++P->serial_;
+        msg->spl = P->sweep_spl_;
+        msg->amplitude = P->amplitude(P->sweep_spl_);
+        msg->num_points = num_points;
+        float *frequency = msg->frequency();
+        for (unsigned i = 0; i < num_points; ++i)
+            frequency[i] = P->an_freqs_[i];
+        proc.send_message(*msg);
+
+        emit currentFrequencyChanged(frequency[0]);
+        return;
+    }
+
+    const unsigned num_points = P->sweep_length_;
+    auto msg = Messages::create<Messages::RequestSweepPlan>(num_points);
+    msg->serial = ++P->serial_;
+    msg->first_spl = P->sweep_spl_;
+    msg->first_index = index;
+    msg->num_levels = P->levels_;
+    for (unsigned l = 0; l < P->levels_; ++l)
+        msg->amplitude[l] = P->amplitude(l);
+    msg->window = P->window_;
+    msg->averages = P->averages_;
+    msg->num_bins = std::min(P->freqs_at_once_, num_points);
+    msg->num_points = num_points;
+    float *frequency = msg->frequency();
+    for (unsigned i = 0; i < num_points; ++i)
+        frequency[i] = P->an_freqs_[i];
+    proc.send_message(*msg);
+
+    emit currentFrequencyChanged(frequency[index]);
+}
+
+
+
+float SweepController::Impl::amplitude(int spl) const
+{
+    return ((unsigned)spl < levels_) ? (level_amplitude_[spl] * output_gain_) : 0.0f;
+}
+
+unsigned SweepController::Impl::row(unsigned channel, int spl) const
+{
+    return (channel * levels_ + spl) * sweep_length_;
+}
+
+void SweepController::Impl::store_response(int spl, unsigned channel, unsigned index, cfloat response, float coherence)
+{
+    if ((unsigned)spl >= levels_)
+        return;
+
+    const unsigned offset = row(channel, spl) + index;
+    unsigned count = an_count_[offset];
+    if (count == 0) {
+        an_sum_[offset] = 0;
+        an_sum_power_[offset] = 0;
+    }
+    an_count_[offset] = ++count;
+    an_sum_[offset] += (cdouble)response;
+    an_sum_power_[offset] += std::norm(response);
+
+    const cfloat mean = (cfloat)(an_sum_[offset] * (1.0 / count));
+    an_response_[offset] = mean;
+    an_coherence_[offset] = coherence;
+    an_plot_mags_[offset] = 20 * std::log10(std::abs(mean));
+    an_plot_phases_[offset] = std::arg(mean);
+    update_difference(spl, channel, index);
+}
+
+bool SweepController::Impl::confident(int spl, unsigned index) const
+{
+    if (confidence_ <= 0)
+        return true;
+
+    // the relative standard error of the mean, from the spread of the
+    // measurements, or for the first one, from its coherence over the
+    // frames; the interval is the magnitude within ±1.96 of this
+    for (unsigned c = 0; c < channels_; ++c) {
+        const unsigned offset = row(c, spl) + index;
+        const unsigned count = an_count_[offset];
+        if (count >= max_repeats_)
+            continue;
+
+        const double mag = std::abs(an_sum_[offset]) / count;
+        double error;
+        if (count > 1) {
+            double variance = (an_sum_power_[offset] - std::norm(an_sum_[offset]) / count) / (count - 1);
+            error = std::sqrt(std::max(0.0, variance) / count);
+        }
+        else if (averages_ > 1) {
+            double coherence = an_coherence_[offset];
+            if (coherence <= 0)
+                return false;
+            error = mag * std::sqrt((1 - coherence) / (2 * coherence * averages_));
+        }
+        else
+            return false;
+
+        if (mag <= 0 || 2 * 20 * std::log10(1 + 1.96 * error / mag) > confidence_)
+            return false;
+    }
+
+    return true;
+}
+
+int SweepController::Impl::reference_level(const Reference &ref, int spl) const
+{
+    // the same drive level, to the precision of the text of the levels
+    const double db = self_->driveLevel(spl);
+    for (unsigned l = 0; l < ref.header->num_levels; ++l) {
+        if (std::abs(ref.header->level_db[l] - db) < 0.01)
+            return l;
+    }
+    return -1;
+}
+
+// the response at a frequency, interpolated in log-frequency between the
+// points around it, in log-magnitude and in phase; false if outside
+static bool interpolate_response(const double *freqs, const cfloat *response, unsigned n, double f, cfloat &result)
+{
+    const double *next = std::lower_bound(freqs, freqs + n, f);
+    if (next == freqs + n)
+        return false;
+    unsigned i = next - freqs;
+    if (*next == f) {
+        result = response[i];
+        return true;
+    }
+    if (i == 0)
+        return false;
+
+    const cfloat a = response[i - 1];
+    const cfloat b = response[i];
+    const double mu = std::log(f / freqs[i - 1]) / std::log(freqs[i] / freqs[i - 1]);
+    if (std::abs(a) <= 0 || std::abs(b) <= 0) {
+        result = (mu < 0.5) ? a : b;
+        return true;
+    }
+    const double mag = std::abs(a) * std::pow(std::abs(b) / std::abs(a), mu);
+    const double phase = std::arg(a) + mu * std::arg(b / a);
+    result = std::polar<float>(mag, phase);
+    return true;
+}
+
+void SweepController::Impl::update_difference(int spl, unsigned channel, unsigned index)
+{
+    const unsigned offset = row(channel, spl) + index;
+    double diff_mag = std::numeric_limits<double>::quiet_NaN();
+    double diff_phase = diff_mag;
+
+    const cfloat response = an_response_[offset];
+    const Reference *ref = references_.empty() ? nullptr : references_.front().get();
+    const int ref_level = ref ? reference_level(*ref, spl) : -1;
+    if (ref_level != -1 && response != cfloat()) {
+        // a reference of fewer channels compares with its first
+        const Profile::Header &hdr = *ref->header;
+        const unsigned ref_channel = (channel < hdr.num_channels) ? channel : 0;
+        const cfloat *ref_response = (const cfloat *)ref->columns[Profile::Column_Response] +
+            (ref_channel * hdr.num_levels + ref_level) * hdr.num_points;
+        cfloat value;
+        if (interpolate_response((const double *)ref->columns[Profile::Column_Frequency], ref_response,
+                                 hdr.num_points, an_freqs_[index], value) && value != cfloat()) {
+            const cfloat ratio = response / value;
+            diff_mag = 20 * std::log10(std::abs(ratio));
+            diff_phase = std::arg(ratio);
+        }
+    }
+
+    an_plot_diff_mags_[offset] = diff_mag;
+    an_plot_diff_phases_[offset] = diff_phase;
+}
+
+void SweepController::Impl::update_differences()
+{
+    for (unsigned c = 0; c < channels_; ++c) {
+        for (unsigned l = 0; l < levels_; ++l) {
+            for (unsigned i = 0; i < sweep_length_; ++i)
+                update_difference(l, c, i);
+        }
+    }
+}
+
+void SweepController::Impl::fit_filters()
+{
+    if (!fitter_)
+        fitter_.reset(new Filter_Fitter(Analysis::filter_fft_size));
+
+    const unsigned ns = sweep_length_;
+    filters_.assign(channels_ * levels_, Filter());
+    std::fill_n(an_plot_filter_.get(), channels_ * levels_ * ns, std::numeric_limits<double>::quiet_NaN());
+
+    for (unsigned c = 0; c < channels_; ++c) {
+        for (unsigned l = 0; l < levels_; ++l) {
+            const unsigned offset = row(c, l);
+            Filter &filter = filters_[c * levels_ + l];
+            if (!fitter_->set_response(an_freqs_.get(), &an_response_[offset], ns, Analysis::sample_rate))
+                continue;
+
+            filter.b.resize(filter_zeros_ + 1);
+            filter.a.resize(filter_poles_ + 1);
+            filter.error = fitter_->fit_iir(filter_zeros_, filter_poles_, filter.b.data(), filter.a.data(), filter_iterations_);
+            if (std::isnan(filter.error)) {
+                filter = Filter();
+                continue;
+            }
+
+            for (unsigned i = 0; i < ns; ++i) {
+                cdouble h = Filter_Fitter::response(
+                    filter.b.data(), filter.b.size(), filter.a.data(), filter.a.size(),
+                    an_freqs_[i], Analysis::sample_rate);
+                an_plot_filter_[offset + i] = 20 * std::log10(std::abs(h));
+            }
+        }
+    }
+}
+
+void SweepController::Impl::reset_progress()
+{
+    const unsigned size = channels_ * levels_ * sweep_length_;
+    sweep_progress_.reset();
+    std::fill_n(an_count_.get(), size, 0);
+    std::fill_n(an_sum_.get(), size, 0);
+    std::fill_n(an_sum_power_.get(), size, 0);
+}
+
+void SweepController::Impl::start_pass()
+{
+    // having measured all, start over, before the first response of the pass
+    if (sweep_progress_.all())
+        reset_progress();
+}
+
+void SweepController::Impl::store_distortion(int spl, unsigned channel, unsigned index, const cfloat *harmonics, float thd, float thdn, float noise)
+{
+    const unsigned offset = row(channel, spl) + index;
+    std::copy_n(harmonics, Analysis::distortion_num_harmonics, &an_distortion_[offset * Analysis::distortion_num_harmonics]);
+    an_thd_[offset] = thd;
+    an_thdn_[offset] = thdn;
+    an_noise_[offset] = noise;
+
+    const double floor = std::pow(10.0, Analysis::distortion_db_min * 0.05);
+    an_plot_thd_[offset] = 20 * std::log10(std::max<double>(thd, floor));
+    an_plot_thdn_[offset] = 20 * std::log10(std::max<double>(thdn, floor));
+}
+
+void SweepController::Impl::update_progress(int spl, unsigned index)
+{
+    sweep_index_ = index;
+    set_sweep_phase(spl);
+
+    emit self_->progressChanged(sweep_progress_.count() * (1.0 / (levels_ * sweep_length_)));
+    emit self_->responsesChanged();
+
+    if (sweep_progress_.all())
+        emit self_->sweepCompleted();
+}
+
+void SweepController::Impl::finish_step(int next_spl, unsigned next_index)
+{
+    update_progress(next_spl, next_index);
+
+    // the next request at once, without a trip through the event loop
+    if (sweep_active_)
+        self_->nextSweepTick();
+}
+
+void SweepController::Impl::restart_plan()
+{
+    if (sweep_active_ && mode_ == Analysis::Mode_Stepped)
+        self_->nextSweepTick();
+}
+
+void SweepController::Impl::set_sweep_phase(int spl)
+{
+    if (sweep_spl_ == spl)
+        return;
+    sweep_spl_ = spl;
+    emit self_->sweepPhaseChanged(spl);
+}
+
+void SweepController::Impl::allocate(unsigned ns)
+{
+    sweep_length_ = ns;
+
+    double *freqs = new double[ns];
+    an_freqs_.reset(freqs);
+
+    for (unsigned i = 0; i < ns; ++i) {
+        const double lx1 = std::log10((double)Analysis::freq_range_min);
+        const double lx2 = std::log10((double)Analysis::freq_range_max);
+        double r = (double)i / (ns - 1);
+        freqs[i] = std::pow(10.0, lx1 + r * (lx2 - lx1));
+    }
+
+    const unsigned size = channels_ * levels_ * ns;
+
+    an_response_.reset(new cfloat[size]());
+    an_coherence_.reset(new float[size]);
+    std::fill_n(an_coherence_.get(), size, 1.0f);
+    an_plot_mags_.reset(new double[size]());
+    an_plot_phases_.reset(new double[size]());
+    an_harmonics_.reset(new cfloat[Analysis::ess_num_harmonics * size]());
+    an_has_harmonics_.reset(new bool[levels_]());
+    an_distortion_.reset(new cfloat[Analysis::distortion_num_harmonics * size]());
+    an_thd_.reset(new float[size]());
+    an_thdn_.reset(new float[size]());
+    an_noise_.reset(new float[size]());
+    an_plot_thd_.reset(new double[size]);
+    an_plot_thdn_.reset(new double[size]);
+    std::fill_n(an_plot_thd_.get(), size, Analysis::distortion_db_min);
+    std::fill_n(an_plot_thdn_.get(), size, Analysis::distortion_db_min);
+    an_has_distortion_.reset(new bool[levels_]());
+    an_count_.reset(new unsigned[size]());
+    an_sum_.reset(new cdouble[size]());
+    an_sum_power_.reset(new double[size]());
+    an_plot_filter_.reset(new double[size]);
+    std::fill_n(an_plot_filter_.get(), size, std::numeric_limits<double>::quiet_NaN());
+    filters_.clear();
+    an_plot_diff_mags_.reset(new double[size]);
+    an_plot_diff_phases_.reset(new double[size]);
+    update_differences();
+
+    sweep_progress_.resize(levels_ * ns);
+}
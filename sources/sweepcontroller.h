@@ -0,0 +1,107 @@
+//          Copyright Jean Pierre Cimalando 2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+#include "profile.h"
+#include <QObject>
+#include <memory>
+class Audio_Processor;
+class QString;
+
+// The measurement, of the responses of all channels and levels over the
+// sweep: it drives the processor through the steps, collects its
+// notifications, and saves the profile. It depends on no widget, and reports
+// by signals to the interface or the batch program which runs it.
+class SweepController : public QObject {
+    Q_OBJECT
+
+public:
+    explicit SweepController(Audio_Processor &proc, QObject *parent = nullptr);
+    ~SweepController();
+
+    // the drive levels in dB, each measured at every step of the sweep
+    void setDriveLevels(const double *levels, unsigned count);
+    unsigned numLevels() const;
+    double driveLevel(unsigned index) const;
+    // the gain of the output, common to the levels
+    void setOutputGain(double gain);
+    double outputGain() const;
+    void setSweepLength(unsigned count);
+    unsigned sweepLength() const;
+    void setFreqsAtOnce(unsigned count);
+    void setWindowFunction(int window);
+    void setAverages(unsigned count);
+    // the width in dB of the confidence interval which ends the repetition
+    // of a stepped point, 0 for a single measurement; and the most
+    // measurements of a point
+    void setConfidence(double width);
+    void setMaxRepeats(unsigned count);
+    void setMeasurementMode(int mode);
+    void setSettleMargin(double margin);
+    void setCrossfade(bool enable);
+    unsigned numChannels() const;
+    // the filter fitted to the response of each channel and level: the
+    // orders of its numerator and denominator, and the iterations which
+    // refine it
+    void setFilterOrder(unsigned zeros, unsigned poles);
+    void setFilterIterations(unsigned count);
+    // the device, or in its place the model of its response at a level:
+    // the minimum-phase impulse response, or the fitted filter; false if
+    // there is no model of this level
+    bool setEmulation(int mode, unsigned level);
+
+    bool sweepActive() const;
+    void setSweepActive(bool active);
+    void measureLatency();
+    void fitFilters();
+    // the binary profile in a directory, and the text files which hold the
+    // same, with the filters fitted to the responses
+    bool saveProfile(const QString &dirname);
+
+    // saved profiles, of which the first is subtracted from the measurement
+    // as it is measured; false if the profile is not readable
+    bool addReference(const QString &filename);
+    void clearReferences();
+    unsigned numReferences() const;
+    const Profile::Header &referenceHeader(unsigned index) const;
+    const void *const *referenceColumns(unsigned index) const;
+
+    // the level-by-frequency matrices of a channel, of the magnitudes and
+    // phases, the distortion ratios in dB, the coherence, the gains of the
+    // filters and the differences to the reference, NaN where there is none
+    const double *frequencies() const;
+    unsigned sweepIndex() const;
+    const double *plotMagnitudes(unsigned channel) const;
+    const double *plotPhases(unsigned channel) const;
+    const double *plotThd(unsigned channel) const;
+    const double *plotThdn(unsigned channel) const;
+    const float *coherence(unsigned channel) const;
+    const double *plotFilter(unsigned channel) const;
+    const double *plotDifferenceMagnitudes(unsigned channel) const;
+    const double *plotDifferencePhases(unsigned channel) const;
+    // the largest deviation in gain of any channel, NaN without reference;
+    // and the largest RMS error of the filters of a channel, NaN without any
+    double deviation() const;
+    double filterError(unsigned channel) const;
+
+signals:
+    void driveLevelsChanged();
+    void sweepPhaseChanged(int spl);
+    void currentFrequencyChanged(double freq);
+    // the fraction of the points measured since the start of the sweep
+    void progressChanged(double progress);
+    // every point measured, after which the sweep starts over if it goes on
+    void sweepCompleted();
+    void responsesChanged();
+    void latencyMeasured(int latency); // samples, or -1 if failed
+
+private slots:
+    void receiveNotifications();
+    void nextSweepTick();
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> P;
+};
@@ -0,0 +1,113 @@
+//          Copyright Jean Pierre Cimalando 2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "counting_bitset.h"
+#include <algorithm>
+
+counting_bitset::counting_bitset(size_t size)
+    : bits_(size)
+{
+}
+
+bool counting_bitset::operator==(const counting_bitset &o) const
+{
+    return count_ == o.count_ && bits_ == o.bits_;
+}
+
+bool counting_bitset::operator!=(const counting_bitset &o) const
+{
+    return !operator==(o);
+}
+
+size_t counting_bitset::size() const
+{
+    return bits_.size();
+}
+
+void counting_bitset::resize(size_t size)
+{
+    count_ = 0;
+    bits_.assign(size, false);
+}
+
+bool counting_bitset::test(size_t pos) const
+{
+    return bits_.at(pos);
+}
+
+bool counting_bitset::all() const
+{
+    return count_ == bits_.size();
+}
+
+bool counting_bitset::any() const
+{
+    return count_ > 0;
+}
+
+bool counting_bitset::none() const
+{
+    return count_ == 0;
+}
+
+size_t counting_bitset::count() const
+{
+    return count_;
+}
+
+counting_bitset &counting_bitset::set()
+{
+    count_ = bits_.size();
+    std::fill(bits_.begin(), bits_.end(), true);
+    return *this;
+}
+
+counting_bitset &counting_bitset::set(size_t pos, bool value)
+{
+    if (bits_.at(pos) != value) {
+        count_ = (ptrdiff_t)count_ + (value ? +1 : -1);
+        bits_[pos] = value;
+    }
+    return *this;
+}
+
+counting_bitset &counting_bitset::reset()
+{
+    count_ = 0;
+    std::fill(bits_.begin(), bits_.end(), false);
+    return *this;
+}
+
+counting_bitset &counting_bitset::reset(size_t pos)
+{
+    set(pos, false);
+    return *this;
+}
+
+counting_bitset &counting_bitset::flip()
+{
+    count_ = bits_.size() - count_;
+    bits_.flip();
+    return *this;
+}
+
+counting_bitset &counting_bitset::flip(size_t pos)
+{
+    bool value = !bits_.at(pos);
+    count_ = (ptrdiff_t)count_ + (value ? +1 : -1);
+    bits_[pos] = value;
+    return *this;
+}
+
+std::string counting_bitset::to_string(char zero, char one) const
+{
+    // most significant first, as std::bitset
+    std::string str(bits_.size(), zero);
+    for (size_t i = 0, n = bits_.size(); i < n; ++i) {
+        if (bits_[i])
+            str[n - 1 - i] = one;
+    }
+    return str;
+}
@@ -4,11 +4,13 @@
 //          http://www.boost.org/LICENSE_1_0.txt)
 
 #pragma once
-#include <bitset>
+#include <vector>
+#include <string>
+#include <cstddef>
 
-template <size_t N>
 struct counting_bitset {
-    constexpr counting_bitset();
+    counting_bitset() = default;
+    explicit counting_bitset(size_t size);
 
     counting_bitset(const counting_bitset &) = default;
     counting_bitset &operator=(const counting_bitset &) = default;
@@ -16,6 +18,9 @@ struct counting_bitset {
     bool operator==(const counting_bitset &o) const;
     bool operator!=(const counting_bitset &o) const;
 
+    size_t size() const;
+    void resize(size_t size); // clears all bits
+
     bool test(size_t pos) const;
 
     bool all() const;
@@ -33,12 +38,9 @@ struct counting_bitset {
     counting_bitset &flip();
     counting_bitset &flip(size_t pos);
 
-    template <class CharT = char, class Traits = std::char_traits<CharT>, class Allocator = std::allocator<CharT>>
-    std::basic_string<CharT, Traits, Allocator> to_string(CharT zero = CharT('0'), CharT one = CharT('1')) const;
+    std::string to_string(char zero = '0', char one = '1') const;
 
 private:
     size_t count_ = 0;
-    std::bitset<N> bits_;
+    std::vector<bool> bits_;
 };
-
-#include "counting_bitset.tcc"
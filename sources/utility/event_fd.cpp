@@ -0,0 +1,74 @@
+//          Copyright Jean Pierre Cimalando 2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "event_fd.h"
+#include <system_error>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#if defined(__linux__)
+#    include <sys/eventfd.h>
+#endif
+
+Event_Fd::Event_Fd()
+{
+#if defined(__linux__)
+    fd_[0] = fd_[1] = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+    if (fd_[0] == -1)
+        throw std::system_error(errno, std::generic_category());
+#else
+    if (pipe(fd_) == -1)
+        throw std::system_error(errno, std::generic_category());
+    for (int fd : fd_) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        fcntl(fd, F_SETFD, fcntl(fd, F_GETFD) | FD_CLOEXEC);
+    }
+#endif
+}
+
+Event_Fd::~Event_Fd()
+{
+    close(fd_[0]);
+    if (fd_[1] != fd_[0])
+        close(fd_[1]);
+}
+
+int Event_Fd::fd() const
+{
+    return fd_[0];
+}
+
+void Event_Fd::signal()
+{
+    // a full pipe or counter is signaled already
+#if defined(__linux__)
+    uint64_t value = 1;
+#else
+    uint8_t value = 1;
+#endif
+    while (write(fd_[1], &value, sizeof(value)) == -1 && errno == EINTR);
+}
+
+void Event_Fd::clear()
+{
+    uint8_t buf[64];
+    for (;;) {
+        ssize_t count = read(fd_[0], buf, sizeof(buf));
+        if (count <= 0 && !(count == -1 && errno == EINTR))
+            break;
+    }
+}
+
+bool Event_Fd::wait(int timeout_ms)
+{
+    pollfd pfd;
+    pfd.fd = fd_[0];
+    pfd.events = POLLIN;
+    int ret;
+    while ((ret = poll(&pfd, 1, timeout_ms)) == -1 && errno == EINTR);
+    return ret > 0;
+}
@@ -0,0 +1,30 @@
+//          Copyright Jean Pierre Cimalando 2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+// A descriptor which becomes readable when signaled, to wake a thread or an
+// event loop: an eventfd on Linux, a pipe elsewhere. Signaling does not
+// block, and the signals merge until cleared.
+class Event_Fd {
+public:
+    Event_Fd();
+    ~Event_Fd();
+
+    Event_Fd(const Event_Fd &) = delete;
+    Event_Fd &operator=(const Event_Fd &) = delete;
+
+    int fd() const;
+
+    void signal();
+    void clear();
+
+    // until signaled, or for the timeout in milliseconds, -1 for none;
+    // false if timed out
+    bool wait(int timeout_ms);
+
+private:
+    int fd_[2] = {-1, -1};
+};
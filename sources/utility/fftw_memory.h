@@ -0,0 +1,15 @@
+//          Copyright Jean Pierre Cimalando 2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+#include <fftw3.h>
+
+struct Fftwf_Deleter {
+    void operator()(void *x) { fftwf_free(x); }
+};
+
+struct Fftwf_Plan_Deleter {
+    void operator()(fftwf_plan x) { fftwf_destroy_plan(x); }
+};
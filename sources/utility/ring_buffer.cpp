@@ -101,5 +101,62 @@ bool Ring_Buffer_Ex<Atomic>::putbytes_(const void *data, size_t len)
     return true;
 }
 
+template <bool Atomic>
+bool Ring_Buffer_Ex<Atomic>::reserve(size_t len, Ring_Span<uint8_t> &span)
+{
+    if (size_free() < len)
+        return false;
+
+    const size_t wp = wp_, cap = cap_;
+    uint8_t *data = rbdata_.get();
+
+    const size_t taillen = std::min(len, cap - wp);
+    span.data[0] = &data[wp];
+    span.size[0] = taillen;
+    span.data[1] = data;
+    span.size[1] = len - taillen;
+    return true;
+}
+
+template <bool Atomic>
+void Ring_Buffer_Ex<Atomic>::commit(size_t len)
+{
+    assert(len <= size_free());
+
+    const size_t wp = wp_, cap = cap_;
+    if_constexpr (Atomic)
+        std::atomic_thread_fence(std::memory_order_release);
+
+    wp_ = (wp + len < cap) ? (wp + len) : (wp + len - cap);
+}
+
+template <bool Atomic>
+bool Ring_Buffer_Ex<Atomic>::read_span(size_t len, Ring_Span<const uint8_t> &span) const
+{
+    if (size_used() < len)
+        return false;
+
+    const size_t rp = rp_, cap = cap_;
+    const uint8_t *data = rbdata_.get();
+    if_constexpr (Atomic)
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+    const size_t taillen = std::min(len, cap - rp);
+    span.data[0] = &data[rp];
+    span.size[0] = taillen;
+    span.data[1] = data;
+    span.size[1] = len - taillen;
+    return true;
+}
+
+template <bool Atomic>
+void Ring_Buffer_Ex<Atomic>::release(size_t len)
+{
+    assert(len <= size_used());
+
+    const size_t rp = rp_, cap = cap_;
+    rp_ = (rp + len < cap) ? (rp + len) : (rp + len - cap);
+}
+
 template class Ring_Buffer_Ex<true>;
 template class Ring_Buffer_Ex<false>;
@@ -19,6 +19,15 @@ static_assert(
 template <bool> class Ring_Buffer_Ex;
 typedef Ring_Buffer_Ex<true> Ring_Buffer;
 
+//------------------------------------------------------------------------------
+// A region of the storage, in one part, or in two if it wraps around the end.
+template <class T>
+struct Ring_Span {
+    T *data[2];
+    size_t size[2];
+    bool contiguous() const { return size[1] == 0; }
+};
+
 //------------------------------------------------------------------------------
 template <class RB>
 class Basic_Ring_Buffer {
@@ -53,6 +62,14 @@ public:
     // write operations
     size_t size_free() const;
     using Base::put;
+    // zero-copy operations: the region of the next `len` bytes, which the
+    // writer fills and then publishes with `commit`, or which the reader
+    // uses in place and then frees with `release`; the storage is one byte
+    // larger than the capacity
+    bool reserve(size_t len, Ring_Span<uint8_t> &span);
+    void commit(size_t len);
+    bool read_span(size_t len, Ring_Span<const uint8_t> &span) const;
+    void release(size_t len);
 
 private:
     size_t cap_{0};
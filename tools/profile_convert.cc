@@ -0,0 +1,240 @@
+//          Copyright Jean Pierre Cimalando 2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+// Converts between the binary profile and the text files of a profile
+// directory: a binary file is written out as text files into the output
+// directory, and a directory of text files is read into a binary file. The
+// text holds no measurement settings, which are given as options, of which
+// the sample rate is required. The lo.dat and hi.dat of the first versions
+// are read as well. With the orders of a filter, the text also has the
+// filter fitted to each response.
+
+#include "profile.h"
+#include "filterfit.h"
+#include "analyzerdefs.h"
+#include "utility/nextpow2.h"
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <getopt.h>
+#include <sys/stat.h>
+
+static const char *const mode_names[] = {"stepped", "sweep", "mls"};
+static const char *const window_names[] = {"hann", "blackman-harris", "flat-top", "rectangular"};
+
+static void usage()
+{
+    std::fprintf(stderr,
+                 "Usage: profile_convert [options] <input> <output>\n"
+                 "  a binary profile to a directory of text files, or the reverse\n"
+                 "Options, for the reverse:\n"
+                 "  -r, --sample-rate <hz>   sample rate of the measurement, required\n"
+                 "  -n, --fft-size <size>    size of the analysis FFT, by default that of the rate\n"
+                 "  -m, --mode <mode>        stepped, sweep or mls, by default stepped\n"
+                 "  -w, --window <window>    hann, blackman-harris, flat-top or rectangular,\n"
+                 "                           by default hann\n"
+                 "  -a, --averages <count>   frames averaged per point, by default 1\n"
+                 "  -g, --gain <db>          output gain, by default %g\n"
+                 "Options, to text:\n"
+                 "  -f, --filter <nz>,<np>   fit filters of these orders\n"
+                 "  -i, --iterations <n>     iterations refining the fit\n",
+                 20 * std::log10(Analysis::output_gain_default));
+}
+
+// the index of a name in a table, or -1
+static int name_index(const char *const names[], unsigned count, const char *name)
+{
+    for (unsigned i = 0; i < count; ++i) {
+        if (std::strcmp(names[i], name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+// a number which is the whole of the argument, false otherwise
+static bool parse_number(const char *arg, double &value)
+{
+    char *end;
+    value = std::strtod(arg, &end);
+    return end != arg && *end == '\0' && std::isfinite(value);
+}
+
+static bool is_directory(const std::string &path)
+{
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+int main(int argc, char *argv[])
+{
+    double sample_rate = 0;
+    unsigned fft_size = 0;
+    int mode = Analysis::Mode_Stepped;
+    int window = Analysis::Window_Hann;
+    unsigned averages = 1;
+    double gain_db = 20 * std::log10(Analysis::output_gain_default);
+    unsigned filter_zeros = 0;
+    unsigned filter_poles = 0;
+    bool filter = false;
+    unsigned filter_iterations = Analysis::filter_iterations_default;
+
+    static const option long_options[] = {
+        {"sample-rate", required_argument, nullptr, 'r'},
+        {"fft-size", required_argument, nullptr, 'n'},
+        {"mode", required_argument, nullptr, 'm'},
+        {"window", required_argument, nullptr, 'w'},
+        {"averages", required_argument, nullptr, 'a'},
+        {"gain", required_argument, nullptr, 'g'},
+        {"filter", required_argument, nullptr, 'f'},
+        {"iterations", required_argument, nullptr, 'i'},
+        {"help", no_argument, nullptr, 'h'},
+        {},
+    };
+
+    for (int c; (c = getopt_long(argc, argv, "r:n:m:w:a:g:f:i:h", long_options, nullptr)) != -1;) {
+        double value;
+        switch (c) {
+        case 'r':
+            if (!parse_number(optarg, sample_rate) || sample_rate <= 0) {
+                std::fprintf(stderr, "Invalid sample rate: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'n':
+            if (!parse_number(optarg, value) || value < 2 || value > (1 << 24) ||
+                nextpow2((unsigned)value) != value) {
+                std::fprintf(stderr, "Invalid FFT size: %s\n", optarg);
+                return 1;
+            }
+            fft_size = (unsigned)value;
+            break;
+        case 'm':
+            mode = name_index(mode_names, sizeof(mode_names) / sizeof(*mode_names), optarg);
+            if (mode == -1) {
+                std::fprintf(stderr, "Invalid measurement mode: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'w':
+            window = name_index(window_names, Analysis::Window_Function_Count, optarg);
+            if (window == -1) {
+                std::fprintf(stderr, "Invalid window function: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'a':
+            if (!parse_number(optarg, value) || value < 1 || value > Analysis::averages_max ||
+                value != (unsigned)value) {
+                std::fprintf(stderr, "Invalid number of averages: %s\n", optarg);
+                return 1;
+            }
+            averages = (unsigned)value;
+            break;
+        case 'g':
+            if (!parse_number(optarg, gain_db) || gain_db > 0) {
+                std::fprintf(stderr, "Invalid output gain: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'f':
+            if (std::sscanf(optarg, "%u,%u", &filter_zeros, &filter_poles) != 2 ||
+                filter_zeros > Analysis::filter_order_max || filter_poles > Analysis::filter_order_max) {
+                usage();
+                return 1;
+            }
+            filter = true;
+            break;
+        case 'i':
+            filter_iterations = std::atoi(optarg);
+            break;
+        case 'h':
+            usage();
+            return 0;
+        default:
+            usage();
+            return 1;
+        }
+    }
+
+    if (argc - optind != 2) {
+        usage();
+        return 1;
+    }
+
+    const std::string input = argv[optind];
+    const std::string output = argv[optind + 1];
+    int status = 0;
+
+    if (is_directory(input)) {
+        // the text has no settings, of which the sample rate has no default
+        if (sample_rate <= 0) {
+            std::fprintf(stderr, "The sample rate is required, by -r\n");
+            return 1;
+        }
+
+        Profile::Data data;
+        if (!Profile::read_dat(input, data)) {
+            std::fprintf(stderr, "Cannot read the text profile: %s\n", input.c_str());
+            return 1;
+        }
+        data.header.sample_rate = sample_rate;
+        data.header.fft_size = fft_size ? fft_size : nextpow2(std::ceil(0.5 * sample_rate));
+        data.header.mode = mode;
+        data.header.window = window;
+        data.header.averages = averages;
+        data.header.gain = std::pow(10.0, gain_db * 0.05);
+        const void *columns[Profile::Column_Count];
+        data.get_columns(columns);
+        if (!Profile::write(output, data.header, columns)) {
+            std::fprintf(stderr, "Cannot write the profile: %s\n", output.c_str());
+            return 1;
+        }
+    }
+    else {
+        Profile_File file;
+        if (!file.open(input)) {
+            std::fprintf(stderr, "Cannot read the profile: %s\n", input.c_str());
+            return 1;
+        }
+        const Profile::Header &hdr = file.header();
+        if (filter && !(hdr.sample_rate > 0)) {
+            std::fprintf(stderr, "Cannot fit filters, the profile has no sample rate: %s\n", input.c_str());
+            return 1;
+        }
+        if (mkdir(output.c_str(), 0777) == -1 && errno != EEXIST) {
+            std::fprintf(stderr, "Cannot create the directory: %s\n", output.c_str());
+            return 1;
+        }
+        const void *columns[Profile::Column_Count];
+        file.get_columns(columns);
+        if (!Profile::write_dat(output, hdr, columns)) {
+            std::fprintf(stderr, "Cannot write the text profile: %s\n", output.c_str());
+            return 1;
+        }
+
+        Filter_Fitter fitter(Analysis::filter_fft_size);
+        std::vector<double> b(filter_zeros + 1), a(filter_poles + 1);
+        for (unsigned c = 0; filter && c < hdr.num_channels; ++c) {
+            for (unsigned l = 0; l < hdr.num_levels; ++l) {
+                if (!fitter.set_response(file.frequency(), file.response(c, l), hdr.num_points, hdr.sample_rate) ||
+                    std::isnan(fitter.fit_iir(filter_zeros, filter_poles, b.data(), a.data(), filter_iterations))) {
+                    std::fprintf(stderr, "Cannot fit the filter of channel %u at %g dB\n", c + 1, hdr.level_db[l]);
+                    status = 1;
+                    continue;
+                }
+                if (!Profile::write_filter(output, hdr, c, l, b.data(), b.size(), a.data(), a.size())) {
+                    std::fprintf(stderr, "Cannot write the filter: %s\n", output.c_str());
+                    return 1;
+                }
+            }
+        }
+    }
+
+    return status;
+}
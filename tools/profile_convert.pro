@@ -0,0 +1,16 @@
+TEMPLATE = app
+CONFIG += console
+CONFIG -= qt
+CONFIG += c++11
+
+INCLUDEPATH += ../sources
+
+SOURCES = \
+    profile_convert.cc \
+    ../sources/profile.cc \
+    ../sources/filterfit.cc
+
+LIBS = -lfftw3f
+
+DESTDIR = ../build
+OBJECTS_DIR = ../build/obj/tools